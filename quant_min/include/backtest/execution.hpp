@@ -6,6 +6,7 @@
 
 #include "backtest/oms.hpp"
 #include "backtest/market_view.hpp"
+#include "common/serialize.hpp"
 
 namespace bt {
 
@@ -82,6 +83,30 @@ public:
     return r;
   }
 
+  // checkpoint：只有还没 drain 的异步回报（cfg 由构造时给）
+  void save(q::ser::Writer& w) const {
+    w.put(static_cast<std::uint64_t>(pending_updates_.size()));
+    for (auto const& u : pending_updates_) {
+      w.put(u.ts_ns);
+      w.put(u.order_id);
+      w.put(u.status);
+      w.put_str(u.reason);
+    }
+  }
+
+  void load(q::ser::Reader& r) {
+    pending_updates_.clear();
+    const auto n = r.get<std::uint64_t>();
+    for (std::uint64_t k = 0; k < n && r.ok(); ++k) {
+      OrderUpdate u;
+      r.get(u.ts_ns);
+      r.get(u.order_id);
+      r.get(u.status);
+      r.get_str(u.reason);
+      pending_updates_.push_back(std::move(u));
+    }
+  }
+
   // Cancel: allow cancel Working/PartiallyFilled
   OrderUpdate cancel(Oms& oms, const MarketView& mv, std::int64_t order_id) {
     auto* o = oms.get(order_id);
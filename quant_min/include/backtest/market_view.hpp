@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 
 struct MarketView {
   std::int64_t ts_ns{};
@@ -0,0 +1,142 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace bt {
+
+// 流式绩效统计：内存与事件数无关
+// - returns：Welford 在线均值/方差（Sharpe）
+// - drawdown：running peak
+// - equity 曲线：按时间分桶降采样，每桶只留最后一个点；超过 max_points 时相邻两桶合并、桶宽翻倍
+class StreamingMetrics {
+public:
+  struct Point {
+    std::int64_t ts_ns{0};
+    long double equity{0.0L};
+  };
+
+  struct Report {
+    std::size_t points{0};
+    long double start_equity{0.0L};
+    long double end_equity{0.0L};
+    long double total_return{0.0L};
+    long double max_drawdown{0.0L};
+    double sharpe{0.0};
+  };
+
+  explicit StreamingMetrics(std::int64_t bucket_ns = 1'000'000'000LL, std::size_t max_points = 4096)
+      : bucket_ns_(bucket_ns > 0 ? bucket_ns : 1), max_points_(max_points < 2 ? 2 : max_points) {
+    curve_.reserve(max_points_ + 1);
+  }
+
+  void add_equity(std::int64_t ts_ns, long double eq) {
+    if (n_ == 0) {
+      first_ = eq;
+      peak_ = eq;
+    } else if (last_ != 0.0L) {
+      add_return((eq - last_) / last_);
+    }
+    ++n_;
+    last_ = eq;
+
+    if (eq > peak_) peak_ = eq;
+    if (peak_ > 0.0L) {
+      const long double dd = (peak_ - eq) / peak_;
+      if (dd > maxdd_) maxdd_ = dd;
+    }
+
+    add_curve_point(ts_ns, eq);
+  }
+
+  std::size_t count() const { return n_; }
+
+  long double total_return() const {
+    if (n_ < 2 || first_ == 0.0L) return 0.0L;
+    return (last_ - first_) / first_;
+  }
+
+  long double max_drawdown() const { return maxdd_; }
+
+  // 简化 Sharpe：对 step returns 计算 mean/std，年化先不做（你后面可以按 bar 频率年化）
+  double sharpe() const {
+    if (rn_ < 2) return 0.0;
+    const long double var = m2_ / static_cast<long double>(rn_ - 1);
+    const long double sd = std::sqrt(var);
+    if (sd == 0.0L) return 0.0;
+    return static_cast<double>(mean_ / sd);
+  }
+
+  // 随时可取（进度输出用）
+  Report report() const {
+    Report r;
+    r.points = n_;
+    r.start_equity = first_;
+    r.end_equity = last_;
+    r.total_return = total_return();
+    r.max_drawdown = max_drawdown();
+    r.sharpe = sharpe();
+    return r;
+  }
+
+  const std::vector<Point>& curve() const { return curve_; }
+  std::int64_t bucket_ns() const { return bucket_ns_; }
+
+private:
+  void add_return(long double r) {
+    ++rn_;
+    const long double d = r - mean_;
+    mean_ += d / static_cast<long double>(rn_);
+    m2_ += d * (r - mean_);
+  }
+
+  std::int64_t bucket_of(std::int64_t ts_ns) const {
+    // floor division（ts 可能为负）
+    std::int64_t b = ts_ns / bucket_ns_;
+    if ((ts_ns % bucket_ns_) != 0 && ts_ns < 0) --b;
+    return b;
+  }
+
+  void add_curve_point(std::int64_t ts_ns, long double eq) {
+    const auto b = bucket_of(ts_ns);
+    if (!curve_.empty() && bucket_of(curve_.back().ts_ns) == b) {
+      curve_.back() = Point{ts_ns, eq};
+      return;
+    }
+    curve_.push_back(Point{ts_ns, eq});
+    if (curve_.size() > max_points_) compact();
+  }
+
+  // 桶宽翻倍，同一新桶里只留最后一个点
+  void compact() {
+    bucket_ns_ *= 2;
+    std::size_t w = 0;
+    for (std::size_t r = 0; r < curve_.size(); ++r) {
+      if (w > 0 && bucket_of(curve_[w - 1].ts_ns) == bucket_of(curve_[r].ts_ns)) {
+        curve_[w - 1] = curve_[r];
+      } else {
+        curve_[w++] = curve_[r];
+      }
+    }
+    curve_.resize(w);
+  }
+
+private:
+  std::size_t n_{0};
+  long double first_{0.0L};
+  long double last_{0.0L};
+  long double peak_{0.0L};
+  long double maxdd_{0.0L};
+
+  // Welford
+  std::size_t rn_{0};
+  long double mean_{0.0L};
+  long double m2_{0.0L};
+
+  std::int64_t bucket_ns_{1};
+  std::size_t max_points_{4096};
+  std::vector<Point> curve_;
+};
+
+} // namespace bt
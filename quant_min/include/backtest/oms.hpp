@@ -1,9 +1,10 @@
 #pragma once
 #include <cstdint>
-#include <unordered_map>
+#include <map>
 #include <vector>
 
 #include "backtest/orders.hpp"
+#include "common/serialize.hpp"
 
 namespace bt {
 
@@ -20,7 +21,8 @@ public:
     o.limit_px = req.limit_px;
     o.status = OrderStatus::PendingNew;
     o.create_ts_ns = ts_ns;
-    auto [it, ok] = orders_.emplace(o.order_id, std::move(o));
+    // id 单调递增 => 总是插在末尾
+    auto it = orders_.emplace_hint(orders_.end(), o.order_id, std::move(o));
     return it->second;
   }
 
@@ -52,6 +54,19 @@ public:
     return out;
   }
 
+  // const 版本的 active 遍历（不分配 vector）
+  template <class F>
+  void for_each_active(F&& f) const {
+    for (auto const& kv : orders_) {
+      auto const& o = kv.second;
+      if (o.status == OrderStatus::Working ||
+          o.status == OrderStatus::PartiallyFilled ||
+          o.status == OrderStatus::CancelRequested) {
+        f(o);
+      }
+    }
+  }
+
   bool has_working(Side side) const {
     for (auto const& kv : orders_) {
       auto const& o = kv.second;
@@ -73,9 +88,27 @@ public:
     return ids;
   }
 
+  // checkpoint：按 order_id 升序存取；遍历顺序（即 ExecutionSim::on_market 的撮合顺序）只由 id 决定，
+  // 与容器内部状态无关 => resume 后 fills 逐笔相同
+  void save(q::ser::Writer& w) const {
+    w.put(last_id_);
+    w.put(static_cast<std::uint64_t>(orders_.size()));
+    for (auto const& kv : orders_) w.put(kv.second);
+  }
+
+  void load(q::ser::Reader& r) {
+    r.get(last_id_);
+    const auto n = r.get<std::uint64_t>();
+    orders_.clear();
+    for (std::uint64_t k = 0; k < n && r.ok(); ++k) {
+      const auto o = r.get<Order>();
+      orders_.emplace_hint(orders_.end(), o.order_id, o);
+    }
+  }
+
 private:
   std::int64_t last_id_{0};
-  std::unordered_map<std::int64_t, Order> orders_;
+  std::map<std::int64_t, Order> orders_; // 按 order_id 有序：撮合 / 遍历顺序确定
 };
 
 } // namespace bt
@@ -0,0 +1,93 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "common/serialize.hpp"
+
+namespace bt {
+
+// 固定容量的滑动窗口限频器：窗口 window_ns 内最多 max_count 次。
+// ring 只保存最近 max_count 个时间戳 —— 第 max_count+1 次能否通过只取决于
+// 最老的那一个是否已滑出窗口，因此 check / record 都是 O(1)，没有 erase/memmove。
+class SlidingWindowLimiter {
+public:
+  SlidingWindowLimiter(std::int64_t window_ns, std::int64_t max_count)
+      : window_ns_(window_ns),
+        ts_(static_cast<std::size_t>(max_count > 0 ? max_count : 0)) {}
+
+  // 与旧实现语义一致：统计 [ts_ns - window, ts_ns] 内的次数，< max_count 才放行
+  bool allow(std::int64_t ts_ns) const {
+    if (ts_.empty()) return false;          // max_count<=0：全部拒绝
+    if (count_ < ts_.size()) return true;   // 还没攒满
+    return ts_[head_] < ts_ns - window_ns_; // head_ 指向最老的记录
+  }
+
+  void record(std::int64_t ts_ns) {
+    if (ts_.empty()) return;
+    ts_[head_] = ts_ns;
+    if (++head_ == ts_.size()) head_ = 0;
+    if (count_ < ts_.size()) ++count_;
+  }
+
+  std::int64_t window_ns() const { return window_ns_; }
+  std::int64_t max_count() const { return static_cast<std::int64_t>(ts_.size()); }
+
+  // checkpoint：窗口参数由构造时给，容量对不上就判失败
+  void save(q::ser::Writer& w) const {
+    w.put_vec(ts_);
+    w.put(head_);
+    w.put(count_);
+  }
+  void load(q::ser::Reader& r) {
+    const auto cap = ts_.size();
+    r.get_vec(ts_);
+    r.get(head_);
+    r.get(count_);
+    if (ts_.size() != cap) r.fail();
+  }
+
+private:
+  std::int64_t window_ns_{0};
+  std::vector<std::int64_t> ts_;
+  std::size_t head_{0};
+  std::size_t count_{0};
+};
+
+// 多窗口组合（类似交易所 throttle：per-100ms / per-1s / per-10s 同时生效）
+class MultiWindowLimiter {
+public:
+  void add_window(std::int64_t window_ns, std::int64_t max_count) {
+    windows_.emplace_back(window_ns, max_count);
+  }
+
+  bool allow(std::int64_t ts_ns) const {
+    for (auto const& w : windows_) {
+      if (!w.allow(ts_ns)) return false;
+    }
+    return true;
+  }
+
+  void record(std::int64_t ts_ns) {
+    for (auto& w : windows_) w.record(ts_ns);
+  }
+
+  std::size_t size() const { return windows_.size(); }
+
+  void save(q::ser::Writer& w) const {
+    w.put(static_cast<std::uint64_t>(windows_.size()));
+    for (auto const& win : windows_) win.save(w);
+  }
+  void load(q::ser::Reader& r) {
+    if (r.get<std::uint64_t>() != windows_.size()) {
+      r.fail();
+      return;
+    }
+    for (auto& win : windows_) win.load(r);
+  }
+
+private:
+  std::vector<SlidingWindowLimiter> windows_;
+};
+
+} // namespace bt
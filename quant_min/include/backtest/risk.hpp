@@ -1,4 +1,6 @@
 #pragma once
+#include <array>
+#include <cassert>
 #include <cstdint>
 #include <optional>
 #include <string>
@@ -9,6 +11,9 @@
 #include "backtest/orders.hpp"
 #include "backtest/oms.hpp"
 #include "backtest/market_view.hpp"
+#include "backtest/rate_limiter.hpp"
+#include "backtest/risk_checks.hpp"
+#include "common/serialize.hpp"
 
 namespace bt {
 
@@ -22,6 +27,9 @@ struct RiskConfig {
   // --- order rate limiting ---
   // 每秒最多发多少 submit（cancel 不计入，或者你也可以计入）
   std::int64_t max_submits_per_sec{50};
+  // 额外的交易所式多窗口限频；<=0 表示不启用
+  std::int64_t max_submits_per_100ms{0};
+  std::int64_t max_submits_per_10s{0};
 
   // --- kill switch ---
   std::int64_t max_consecutive_rejects{20};     // 连续被风控/执行拒单次数上限
@@ -31,52 +39,164 @@ struct RiskConfig {
   bool require_valid_market{true}; // 没有 bid/ask 时拒单
 };
 
-class RiskManager {
+// pre_submit_check 的入参
+struct SubmitCheckCtx {
+  const MarketView& mv;
+  const OrderRequest& req;
+  std::int64_t current_position;
+};
+
+namespace checks {
+
+struct ValidMarket {
+  static constexpr const char* name = "valid_market";
+  template <class Owner>
+  static RejectCode check(const Owner& o, const SubmitCheckCtx& c) {
+    if (!o.cfg().require_valid_market) return RejectCode::None;
+    return (c.mv.best_bid_px <= 0 || c.mv.best_ask_px <= 0) ? RejectCode::NoMarket : RejectCode::None;
+  }
+};
+
+struct LimitPxPositive {
+  static constexpr const char* name = "limit_px_positive";
+  template <class Owner>
+  static RejectCode check(const Owner&, const SubmitCheckCtx& c) {
+    return c.req.limit_px <= 0 ? RejectCode::LimitPxNonPositive : RejectCode::None;
+  }
+};
+
+// 活跃挂单数限制（增量计数，O(1)）
+struct MaxActiveOrders {
+  static constexpr const char* name = "max_active_orders";
+  template <class Owner>
+  static RejectCode check(const Owner& o, const SubmitCheckCtx&) {
+    return o.active_orders() >= o.cfg().max_active_orders ? RejectCode::TooManyActiveOrders : RejectCode::None;
+  }
+};
+
+struct MaxActiveOrdersSide {
+  static constexpr const char* name = "max_active_orders_side";
+  template <class Owner>
+  static RejectCode check(const Owner& o, const SubmitCheckCtx& c) {
+    return o.active_orders(c.req.side) >= o.cfg().max_active_orders_per_side
+               ? RejectCode::TooManyActiveOrdersSide : RejectCode::None;
+  }
+};
+
+// 下单频率限制（按 mv.ts_ns）
+struct RateLimit {
+  static constexpr const char* name = "rate_limit";
+  template <class Owner>
+  static RejectCode check(const Owner& o, const SubmitCheckCtx& c) {
+    return o.rate_limit_ok(c.mv.ts_ns) ? RejectCode::None : RejectCode::RateLimited;
+  }
+};
+
+// 仓位限制：用“最坏情况”估算（假设该单全部成交）
+struct PositionLimit {
+  static constexpr const char* name = "position_limit";
+  template <class Owner>
+  static RejectCode check(const Owner& o, const SubmitCheckCtx& c) {
+    const std::int64_t next_pos = c.current_position + ((c.req.side == Side::Buy) ? c.req.qty : -c.req.qty);
+    return std::llabs(next_pos) > o.cfg().max_abs_position ? RejectCode::PositionLimit : RejectCode::None;
+  }
+};
+
+} // namespace checks
+
+// 默认检查顺序与旧版 pre_submit_check 一致
+using DefaultSubmitChecks = CheckPipeline<checks::ValidMarket,
+                                          checks::QtyPositive,
+                                          checks::MaxOrderQty,
+                                          checks::LimitPxPositive,
+                                          checks::MaxActiveOrders,
+                                          checks::MaxActiveOrdersSide,
+                                          checks::RateLimit,
+                                          checks::PositionLimit>;
+
+template <class SubmitChecks>
+class BasicRiskManager {
 public:
-  explicit RiskManager(RiskConfig cfg = {}) : cfg_(cfg) {}
+  explicit BasicRiskManager(RiskConfig cfg = {}) : cfg_(cfg) {
+    // 1s 窗口始终生效（max_submits_per_sec<=0 即全部拒绝，与旧行为一致）
+    limiter_.add_window(1'000'000'000LL, cfg_.max_submits_per_sec);
+    if (cfg_.max_submits_per_100ms > 0) limiter_.add_window(100'000'000LL, cfg_.max_submits_per_100ms);
+    if (cfg_.max_submits_per_10s > 0) limiter_.add_window(10'000'000'000LL, cfg_.max_submits_per_10s);
+  }
 
   struct Decision {
     bool ok{true};
-    std::string reason;
+    RejectCode code{RejectCode::None};
+    const char* reason{""};
   };
 
-  // 下单前检查：通过返回 {ok=true}；拒绝则 ok=false & reason
+  // 下单前检查：通过返回 {ok=true}；拒绝则 ok=false & code/reason
   Decision pre_submit_check(const Oms& oms,
                             const MarketView& mv,
                             const OrderRequest& req,
                             std::int64_t current_position) {
-    if (killed_) return {false, "killed"};
+    if (killed_) return {false, RejectCode::Killed, reject_reason(RejectCode::Killed)};
 
-    if (cfg_.require_valid_market) {
-      if (mv.best_bid_px <= 0 || mv.best_ask_px <= 0) return reject("no_market");
-    }
+    debug_check_counters(oms);
+    const auto rc = checks_.run(*this, SubmitCheckCtx{mv, req, current_position});
+    if (rc != RejectCode::None) [[unlikely]] return reject(rc);
 
-    if (req.qty <= 0) return reject("qty<=0");
-    if (req.qty > cfg_.max_order_qty) return reject("qty>max_order_qty");
-    if (req.limit_px <= 0) return reject("limit_px<=0");
+    // 通过
+    record_submit(mv.ts_ns);
+    return {};
+  }
 
-    // 活跃挂单数限制
-    const auto active = count_active_orders(oms);
-    if (active >= cfg_.max_active_orders) return reject("too_many_active_orders");
+  const RiskConfig& cfg() const { return cfg_; }
 
-    const auto active_side = count_active_orders_side(oms, req.side);
-    if (active_side >= cfg_.max_active_orders_per_side) return reject("too_many_active_orders_side");
+  // 各窗口都是固定容量 ring，O(1)
+  bool rate_limit_ok(std::int64_t ts_ns) const { return limiter_.allow(ts_ns); }
 
-    // 下单频率限制（按 mv.ts_ns）
-    if (!rate_limit_ok(mv.ts_ns)) return reject("rate_limited");
+  // per-check 计数 / 耗时
+  const SubmitChecks& checks() const { return checks_; }
+  void set_check_timing(bool on) { checks_.set_timing(on); }
 
-    // 仓位限制：用“最坏情况”估算（假设该单全部成交）
-    std::int64_t next_pos = current_position;
-    if (req.side == Side::Buy) next_pos += req.qty;
-    else next_pos -= req.qty;
+  // ---- order-update stream：增量维护活跃挂单数 / 在途敞口 ----
+  // 每个 RiskManager 只对应一个 symbol，所以这里的计数即 per-symbol 计数
 
-    if (std::llabs(next_pos) > cfg_.max_abs_position) return reject("position_limit");
+  // submit 回报：Working/PartiallyFilled 才开始跟踪（leaves 以请求 qty 起算，之后由 on_fill 扣减）
+  void on_submit_ack(const OrderRequest& req, const OrderUpdate& ack) {
+    if (ack.order_id == 0) return;
+    if (ack.status != OrderStatus::Working && ack.status != OrderStatus::PartiallyFilled) return;
+    auto [it, inserted] = open_.emplace(ack.order_id, OpenOrder{req.side, req.qty, req.limit_px});
+    if (!inserted) return;
+    const auto s = side_idx(req.side);
+    ++active_orders_;
+    ++active_orders_side_[s];
+    open_qty_side_[s] += req.qty;
+    open_notional_side_[s] += req.qty * req.limit_px;
+  }
 
-    // 通过
-    record_submit(mv.ts_ns);
-    return {true, ""};
+  void on_fill(const FillEvent& f) {
+    auto it = open_.find(f.order_id);
+    if (it == open_.end()) return;
+    auto& oo = it->second;
+    const auto qty = std::min(f.qty, oo.leaves_qty);
+    const auto s = side_idx(oo.side);
+    oo.leaves_qty -= qty;
+    open_qty_side_[s] -= qty;
+    open_notional_side_[s] -= qty * oo.limit_px;
+    if (oo.leaves_qty == 0) erase_open(it);
+  }
+
+  // 异步回报：终态（Canceled/Filled/Rejected）即移出；CancelRequested 仍算活跃
+  void on_order_update(const OrderUpdate& up) {
+    if (up.status != OrderStatus::Canceled &&
+        up.status != OrderStatus::Filled &&
+        up.status != OrderStatus::Rejected) return;
+    auto it = open_.find(up.order_id);
+    if (it != open_.end()) erase_open(it);
   }
 
+  std::int64_t active_orders() const { return active_orders_; }
+  std::int64_t active_orders(Side side) const { return active_orders_side_[side_idx(side)]; }
+  std::int64_t open_qty(Side side) const { return open_qty_side_[side_idx(side)]; }
+  std::int64_t open_notional(Side side) const { return open_notional_side_[side_idx(side)]; }
+
   // 记录执行层的拒单（例如 ExecutionSim 返回 ack=Rejected）
   void on_exec_reject(std::int64_t ts_ns, const std::string& reason) {
     (void)ts_ns;
@@ -97,64 +217,106 @@ public:
   std::int64_t consecutive_rejects() const { return consecutive_rejects_; }
   const std::string& last_reject_reason() const { return last_reject_reason_; }
 
+  // checkpoint：kill switch / 限频窗口 / 在途挂单（cfg 与 per-check 计数不存）
+  void save(q::ser::Writer& w) const {
+    w.put(killed_);
+    w.put(consecutive_rejects_);
+    w.put_str(last_reject_reason_);
+    limiter_.save(w);
+    w.put(static_cast<std::uint64_t>(open_.size()));
+    for (auto const& kv : open_) {
+      w.put(kv.first);
+      w.put(kv.second);
+    }
+    w.put(active_orders_);
+    w.put(active_orders_side_);
+    w.put(open_qty_side_);
+    w.put(open_notional_side_);
+  }
+
+  void load(q::ser::Reader& r) {
+    r.get(killed_);
+    r.get(consecutive_rejects_);
+    r.get_str(last_reject_reason_);
+    limiter_.load(r);
+    open_.clear();
+    const auto n = r.get<std::uint64_t>();
+    for (std::uint64_t k = 0; k < n && r.ok(); ++k) {
+      const auto id = r.get<std::int64_t>();
+      open_.emplace(id, r.get<OpenOrder>());
+    }
+    r.get(active_orders_);
+    r.get(active_orders_side_);
+    r.get(open_qty_side_);
+    r.get(open_notional_side_);
+  }
+
 private:
-  Decision reject(const char* r) {
+  Decision reject(RejectCode rc) {
+    const char* r = reject_reason(rc);
     ++consecutive_rejects_;
     last_reject_reason_ = r;
     if (cfg_.enable_kill_switch && consecutive_rejects_ >= cfg_.max_consecutive_rejects) killed_ = true;
-    return {false, r};
+    return {false, rc, r};
   }
 
-  static bool is_active(const Order& o) {
-    return o.status == OrderStatus::Working ||
-           o.status == OrderStatus::PartiallyFilled ||
-           o.status == OrderStatus::CancelRequested;
-  }
+  struct OpenOrder {
+    Side side{Side::Buy};
+    std::int64_t leaves_qty{0};
+    std::int64_t limit_px{0};
+  };
 
-  static std::int64_t count_active_orders(const Oms& oms) {
-    std::int64_t c = 0;
-    // 这里利用 active_orders()（它包含 Working/PartiallyFilled/CancelRequested）
-    for (auto* o : const_cast<Oms&>(oms).active_orders()) { // active_orders 不是 const；先这么用最小改动
-      if (o && is_active(*o)) ++c;
-    }
-    return c;
-  }
+  static std::size_t side_idx(Side side) { return static_cast<std::size_t>(side); }
 
-  static std::int64_t count_active_orders_side(const Oms& oms, Side side) {
-    std::int64_t c = 0;
-    for (auto* o : const_cast<Oms&>(oms).active_orders()) {
-      if (o && is_active(*o) && o->side == side) ++c;
-    }
-    return c;
+  void erase_open(typename std::unordered_map<std::int64_t, OpenOrder>::iterator it) {
+    const auto s = side_idx(it->second.side);
+    --active_orders_;
+    --active_orders_side_[s];
+    open_qty_side_[s] -= it->second.leaves_qty;
+    open_notional_side_[s] -= it->second.leaves_qty * it->second.limit_px;
+    open_.erase(it);
   }
 
-  bool rate_limit_ok(std::int64_t ts_ns) const {
-    // 一秒窗口：统计最近 1s 内的 submit 次数
-    const std::int64_t window = 1'000'000'000LL;
-    // 允许 ts 不严格单调，但你这里是回放/事件驱动，基本单调
-    // 清理旧记录
-    auto it = std::lower_bound(submit_ts_.begin(), submit_ts_.end(), ts_ns - window);
-    const auto recent = static_cast<std::int64_t>(submit_ts_.end() - it);
-    return recent < cfg_.max_submits_per_sec;
+  // debug 下与 OMS 全量扫描对账；release（NDEBUG）下为空
+  void debug_check_counters(const Oms& oms) const {
+#ifndef NDEBUG
+    std::int64_t total = 0;
+    std::array<std::int64_t, 2> per_side{};
+    std::array<std::int64_t, 2> qty_side{};
+    oms.for_each_active([&](const Order& o) {
+      ++total;
+      ++per_side[side_idx(o.side)];
+      qty_side[side_idx(o.side)] += o.leaves_qty;
+    });
+    assert(total == active_orders_ && "RiskManager: active order count out of sync with OMS");
+    assert(per_side == active_orders_side_ && "RiskManager: per-side active count out of sync with OMS");
+    assert(qty_side == open_qty_side_ && "RiskManager: open qty out of sync with OMS");
+#else
+    (void)oms;
+#endif
   }
 
-  void record_submit(std::int64_t ts_ns) {
-    submit_ts_.push_back(ts_ns);
-    // 控制数组大小：只保留最近 2s 的即可
-    const std::int64_t keep = 2'000'000'000LL;
-    auto it = std::lower_bound(submit_ts_.begin(), submit_ts_.end(), ts_ns - keep);
-    if (it != submit_ts_.begin()) submit_ts_.erase(submit_ts_.begin(), it);
-  }
+  void record_submit(std::int64_t ts_ns) { limiter_.record(ts_ns); }
 
 private:
   RiskConfig cfg_;
+  SubmitChecks checks_;
 
   bool killed_{false};
   std::int64_t consecutive_rejects_{0};
   std::string last_reject_reason_;
 
-  // submit 时间戳序列（用于 rate limiting）
-  std::vector<std::int64_t> submit_ts_;
+  // submit 限频（多窗口，ring 实现）
+  MultiWindowLimiter limiter_;
+
+  // 增量维护的活跃挂单 / 在途敞口（由 order-update stream 驱动）
+  std::unordered_map<std::int64_t, OpenOrder> open_;
+  std::int64_t active_orders_{0};
+  std::array<std::int64_t, 2> active_orders_side_{};
+  std::array<std::int64_t, 2> open_qty_side_{};
+  std::array<std::int64_t, 2> open_notional_side_{};
 };
 
+using RiskManager = BasicRiskManager<DefaultSubmitChecks>;
+
 } // namespace bt
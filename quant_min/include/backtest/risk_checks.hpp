@@ -0,0 +1,145 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "common/clock.hpp"
+
+namespace bt {
+
+// 风控拒单码：热路径只传 1 字节，字符串只在需要打印时才取
+enum class RejectCode : std::uint8_t {
+  None = 0,
+  Killed,
+  NoMarket,
+  QtyNonPositive,
+  QtyTooLarge,
+  LimitPxNonPositive,
+  TooManyActiveOrders,
+  TooManyActiveOrdersSide,
+  RateLimited,
+  PositionLimit,
+  NoMid,
+  PositionLimitSym,
+  GrossNotional,
+  GroupNotional,
+  NotionalOverflow,
+};
+
+inline const char* reject_reason(RejectCode c) {
+  switch (c) {
+    case RejectCode::None:                    return "";
+    case RejectCode::Killed:                  return "killed";
+    case RejectCode::NoMarket:                return "no_market";
+    case RejectCode::QtyNonPositive:          return "qty<=0";
+    case RejectCode::QtyTooLarge:             return "qty>max_order_qty";
+    case RejectCode::LimitPxNonPositive:      return "limit_px<=0";
+    case RejectCode::TooManyActiveOrders:     return "too_many_active_orders";
+    case RejectCode::TooManyActiveOrdersSide: return "too_many_active_orders_side";
+    case RejectCode::RateLimited:             return "rate_limited";
+    case RejectCode::PositionLimit:           return "position_limit";
+    case RejectCode::NoMid:                   return "no_mid";
+    case RejectCode::PositionLimitSym:        return "pos_limit_sym";
+    case RejectCode::GrossNotional:           return "gross_notional";
+    case RejectCode::GroupNotional:           return "group_notional";
+    case RejectCode::NotionalOverflow:        return "notional_overflow";
+  }
+  return "unknown";
+}
+
+struct CheckCounter {
+  std::uint64_t calls{0};   // 仅 timing 打开时统计
+  std::uint64_t rejects{0};
+  std::int64_t total_ns{0}; // 仅 timing 打开时统计
+};
+
+// 编译期组合的检查流水线：
+// - 每个 Check 是一个无状态类型，提供
+//     static constexpr const char* name;
+//     template <class Owner, class Ctx> static RejectCode check(const Owner&, const Ctx&);
+//   Owner（RiskManager / PortfolioRisk）提供 cfg 与状态，Ctx 是本次下单的参数
+// - 按模板参数顺序短路执行，第一个非 None 即返回；没列进来的检查完全不产生代码
+// - set_timing(true) 后按 check 统计调用次数与耗时（默认关闭，只数 reject）
+template <class... Checks>
+class CheckPipeline {
+public:
+  static constexpr std::size_t size() { return sizeof...(Checks); }
+
+  static constexpr std::array<const char*, sizeof...(Checks)> names() {
+    return {Checks::name...};
+  }
+
+  template <class Owner, class Ctx>
+  RejectCode run(const Owner& owner, const Ctx& ctx) {
+    if (timing_) return run_timed(owner, ctx, std::index_sequence_for<Checks...>{});
+    return run_fast(owner, ctx, std::index_sequence_for<Checks...>{});
+  }
+
+  void set_timing(bool on) { timing_ = on; }
+  bool timing() const { return timing_; }
+
+  const std::array<CheckCounter, sizeof...(Checks)>& counters() const { return counters_; }
+
+private:
+  template <class Owner, class Ctx, std::size_t... I>
+  RejectCode run_fast(const Owner& owner, const Ctx& ctx, std::index_sequence<I...>) {
+    RejectCode rc = RejectCode::None;
+    (((rc = step_fast<I, Checks>(owner, ctx)) == RejectCode::None) && ...);
+    return rc;
+  }
+
+  template <class Owner, class Ctx, std::size_t... I>
+  RejectCode run_timed(const Owner& owner, const Ctx& ctx, std::index_sequence<I...>) {
+    RejectCode rc = RejectCode::None;
+    (((rc = step_timed<I, Checks>(owner, ctx)) == RejectCode::None) && ...);
+    return rc;
+  }
+
+  template <std::size_t I, class Check, class Owner, class Ctx>
+  RejectCode step_fast(const Owner& owner, const Ctx& ctx) {
+    const auto rc = Check::check(owner, ctx);
+    if (rc != RejectCode::None) [[unlikely]] ++counters_[I].rejects;
+    return rc;
+  }
+
+  template <std::size_t I, class Check, class Owner, class Ctx>
+  RejectCode step_timed(const Owner& owner, const Ctx& ctx) {
+    const auto t0 = q::now();
+    const auto rc = Check::check(owner, ctx);
+    const auto t1 = q::now();
+    auto& c = counters_[I];
+    ++c.calls;
+    c.total_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+    if (rc != RejectCode::None) ++c.rejects;
+    return rc;
+  }
+
+private:
+  bool timing_{false};
+  std::array<CheckCounter, sizeof...(Checks)> counters_{};
+};
+
+// ---- 通用检查（Ctx 需有 req: bt::OrderRequest，Owner 的 cfg() 需有 max_order_qty）----
+namespace checks {
+
+struct QtyPositive {
+  static constexpr const char* name = "qty_positive";
+  template <class Owner, class Ctx>
+  static RejectCode check(const Owner&, const Ctx& c) {
+    return c.req.qty <= 0 ? RejectCode::QtyNonPositive : RejectCode::None;
+  }
+};
+
+struct MaxOrderQty {
+  static constexpr const char* name = "max_order_qty";
+  template <class Owner, class Ctx>
+  static RejectCode check(const Owner& o, const Ctx& c) {
+    return c.req.qty > o.cfg().max_order_qty ? RejectCode::QtyTooLarge : RejectCode::None;
+  }
+};
+
+} // namespace checks
+
+} // namespace bt
@@ -0,0 +1,236 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "common/serialize.hpp"
+
+namespace bt3 {
+
+struct CheckpointConfig {
+  std::string dir;              // <dir>/ckpt_<batch>.bin
+  std::size_t every_batches{0}; // 每多少个 batch 做一次；0 = 关闭
+  std::size_t keep{2};          // 保留最近几份（更老的写完新的之后删掉）
+};
+
+// 一份 checkpoint 的内存镜像：
+// - head：engine 计数 / 调度游标 / 组合 / 组合风控 / pipelined 已取未处理的 batch（主线程写）
+// - strat：策略状态（策略有 save / load hook 时）
+// - syms：每个 SymbolContext 一段，由 owning worker 并行序列化
+struct CheckpointImage {
+  std::uint64_t batch{0};
+  std::string head;
+  std::string strat;
+  std::vector<std::string> syms;
+};
+
+namespace ckpt {
+
+inline constexpr char kMagic[8] = {'B', 'T', '3', 'C', 'K', 'P', 'T', '1'};
+inline constexpr char kEndMagic[8] = {'B', 'T', '3', 'C', 'K', 'E', 'N', 'D'};
+inline constexpr std::uint32_t kVersion = 4;
+
+inline std::string file_name(std::uint64_t batch) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "ckpt_%012llu.bin", static_cast<unsigned long long>(batch));
+  return buf;
+}
+
+// dir 下的 checkpoint 文件，按 batch 升序（文件名零填充 => 字典序即 batch 序）
+inline std::vector<std::string> list(const std::string& dir) {
+  std::vector<std::string> out;
+  std::error_code ec;
+  if (!std::filesystem::is_directory(dir, ec)) return out;
+  for (auto const& ent : std::filesystem::directory_iterator(dir, ec)) {
+    const auto name = ent.path().filename().string();
+    if (ent.is_regular_file() && name.rfind("ckpt_", 0) == 0 && ent.path().extension() == ".bin") {
+      out.push_back(ent.path().string());
+    }
+  }
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+// 最新的一份；没有返回空串
+inline std::string latest(const std::string& dir) {
+  auto v = list(dir);
+  return v.empty() ? std::string{} : v.back();
+}
+
+// 文件：magic(8) version(4) n_syms(4) batch(8) | head | strat | n_syms 段 | end magic(8)，各段带 u64 长度
+inline bool write_file(const std::string& path, const CheckpointImage& img) {
+  std::ofstream f(path, std::ios::binary | std::ios::trunc);
+  if (!f) return false;
+  auto put = [&f](const auto& v) { f.write(reinterpret_cast<const char*>(&v), sizeof(v)); };
+  auto put_blob = [&f, &put](const std::string& s) {
+    put(static_cast<std::uint64_t>(s.size()));
+    f.write(s.data(), static_cast<std::streamsize>(s.size()));
+  };
+  f.write(kMagic, sizeof(kMagic));
+  put(kVersion);
+  put(static_cast<std::uint32_t>(img.syms.size()));
+  put(img.batch);
+  put_blob(img.head);
+  put_blob(img.strat);
+  for (auto const& s : img.syms) put_blob(s);
+  f.write(kEndMagic, sizeof(kEndMagic));
+  f.close();
+  return !f.fail();
+}
+
+inline bool read_file(const std::string& path, CheckpointImage& img) {
+  std::ifstream f(path, std::ios::binary | std::ios::ate);
+  if (!f) return false;
+  std::string data(static_cast<std::size_t>(f.tellg()), '\0');
+  f.seekg(0);
+  if (!f.read(data.data(), static_cast<std::streamsize>(data.size()))) return false;
+  q::ser::Reader r(data);
+  char magic[8];
+  for (auto& c : magic) r.get(c);
+  if (!r.ok() || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0 || r.get<std::uint32_t>() != kVersion) return false;
+  const auto n_syms = r.get<std::uint32_t>();
+  r.get(img.batch);
+  r.get_str(img.head);
+  r.get_str(img.strat);
+  img.syms.resize(n_syms);
+  for (auto& s : img.syms) r.get_str(s);
+  for (auto& c : magic) r.get(c);
+  return r.ok() && std::memcmp(magic, kEndMagic, sizeof(kEndMagic)) == 0 && r.remaining() == 0;
+}
+
+} // namespace ckpt
+
+// 异步 checkpoint：两份镜像双缓冲，后台线程写盘（先写 .tmp 再 rename，崩溃时不会留下半个文件）
+// - engine 在 batch 边界 acquire() 一份空闲镜像、填好后 submit()，不等 I/O
+// - 上一份还在写时新的排队；排队中的又被更新的覆盖（只保证最新的那份落盘，计入 superseded）
+// - 线程安全：acquire / submit 只由驱动 engine 的线程调用
+class CheckpointWriter {
+public:
+  explicit CheckpointWriter(CheckpointConfig cfg) : cfg_(std::move(cfg)) {
+    std::error_code ec;
+    std::filesystem::create_directories(cfg_.dir, ec);
+    thread_ = std::thread([this]() { loop(); });
+  }
+
+  ~CheckpointWriter() {
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
+  }
+
+  CheckpointWriter(const CheckpointWriter&) = delete;
+  CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+  const CheckpointConfig& cfg() const { return cfg_; }
+  bool due(std::size_t batch) const { return cfg_.every_batches > 0 && batch % cfg_.every_batches == 0; }
+
+  // 不在写盘的那份；若它正排队等写，就被这次覆盖
+  CheckpointImage& acquire() {
+    std::lock_guard<std::mutex> lk(mu_);
+    const int k = writing_ == 0 ? 1 : 0;
+    if (queued_ == k) {
+      queued_ = -1;
+      ++stats_.superseded;
+    }
+    return img_[static_cast<std::size_t>(k)];
+  }
+
+  void submit(const CheckpointImage& img) {
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      queued_ = &img == &img_[0] ? 0 : 1;
+    }
+    cv_.notify_all();
+  }
+
+  // 等排队 / 在写的都落盘
+  void flush() {
+    std::unique_lock<std::mutex> lk(mu_);
+    cv_.wait(lk, [this]() { return queued_ < 0 && writing_ < 0; });
+  }
+
+  struct Stats {
+    std::uint64_t written{0};
+    std::uint64_t superseded{0};
+    std::uint64_t failed{0};
+    std::uint64_t bytes{0};
+    std::uint64_t last_batch{0};
+  };
+  Stats stats() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return stats_;
+  }
+
+private:
+  void loop() {
+    for (;;) {
+      int k = -1;
+      {
+        std::unique_lock<std::mutex> lk(mu_);
+        cv_.wait(lk, [this]() { return stop_ || queued_ >= 0; });
+        if (queued_ < 0) return; // stop 且没有待写的
+        k = queued_;
+        queued_ = -1;
+        writing_ = k;
+      }
+
+      const auto& img = img_[static_cast<std::size_t>(k)];
+      const auto path = (std::filesystem::path(cfg_.dir) / ckpt::file_name(img.batch)).string();
+      const auto tmp = path + ".tmp";
+      bool ok = ckpt::write_file(tmp, img);
+      std::error_code ec;
+      if (ok) std::filesystem::rename(tmp, path, ec);
+      ok = ok && !ec;
+      if (!ok) std::filesystem::remove(tmp, ec);
+      if (ok) prune();
+
+      std::uint64_t bytes = 0;
+      for (auto const& s : img.syms) bytes += s.size();
+      {
+        std::lock_guard<std::mutex> lk(mu_);
+        writing_ = -1;
+        if (ok) {
+          ++stats_.written;
+          stats_.bytes += img.head.size() + img.strat.size() + bytes;
+          stats_.last_batch = img.batch;
+        } else {
+          ++stats_.failed;
+        }
+      }
+      cv_.notify_all();
+    }
+  }
+
+  void prune() {
+    auto files = ckpt::list(cfg_.dir);
+    const auto keep = std::max<std::size_t>(cfg_.keep, 1);
+    std::error_code ec;
+    for (std::size_t k = 0; k + keep < files.size(); ++k) std::filesystem::remove(files[k], ec);
+  }
+
+  CheckpointConfig cfg_;
+  std::array<CheckpointImage, 2> img_;
+  mutable std::mutex mu_;
+  std::condition_variable cv_;
+  int queued_{-1};  // 等写盘的镜像
+  int writing_{-1}; // 后台线程正在写的镜像
+  bool stop_{false};
+  Stats stats_{};
+  std::thread thread_;
+};
+
+} // namespace bt3
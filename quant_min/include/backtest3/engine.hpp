@@ -1,24 +1,138 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
-#include <functional>
 #include <iostream>
+#include <memory>
+#include <numeric>
+#include <span>
 #include <utility>
 #include <vector>
 
+#include "common/trace.hpp"
 #include "backtest3/worker_pool.hpp"
+#include "backtest3/journal.hpp"
+#include "backtest3/checkpoint.hpp"
 #include "backtest3/symbol_context.hpp"
 #include "backtest3/portfolio.hpp"
-#include "backtest3/strategy_portfolio.hpp"
+#include "backtest3/portfolio_risk.hpp"
+#include "backtest3/profile.hpp"
+#include "backtest3/shard.hpp"
+#include "backtest3/strategy_api.hpp"
 
 namespace bt3 {
 
+// 初始归属；运行中由 rebalance 按负载重分配
 inline std::size_t owner_worker(std::size_t sym_idx, std::size_t n_workers) {
   return sym_idx % n_workers; // 之后你可以做 NUMA grouping
 }
 
 struct EngineConfig {
   std::size_t n_workers{4};
+  // 组合风控：策略的 submit 在进入 Phase B 前逐笔过 PortfolioRisk（O(1)/笔）
+  bool enable_portfolio_risk{false};
+  // 一个 phase 的工作量（events / commands）不超过它时直接在主线程跑，不唤醒 worker
+  std::size_t inline_max_work{16};
+  // pipelined：主线程跑 strat.on_batch(ts) 的同时，worker 预建 ts+1 的 book（只推进 book，不撮合）
+  // 撮合仍在下一轮 Phase A 按事件顺序回放，fills 与串行模式逐笔一致（fill_digest 可对账）
+  bool pipeline{false};
+  // 负载均衡：每 rebalance_every 个 batch，按累计 per-symbol 成本（events + commands）做一次 LPT 重分配
+  // 成本每次重分配后减半（近期负载权重更高）；0 = 关（固定 round-robin，默认；与 enable_stealing 一样按需打开）
+  std::size_t rebalance_every{0};
+  // phase 内 work stealing：worker 做完自己的列表后，按整只 symbol 认领别人还没开始的
+  // （同一 phase 内每只 symbol 仍只被一个线程处理）
+  bool enable_stealing{false};
+  // 每 progress_every 个 batch 打一行进度（0 = 不打）
+  std::size_t progress_every{1000};
+  // 不打印进度 / DONE 行（sweep 里同时跑很多个 engine 时用 RunStats 汇总）
+  bool quiet{false};
+  // per-phase 耗时 / 分配次数、per-worker busy / wait / 负载，run() 之后从 profile() 读（关闭时不取时钟）
+  bool profile{false};
+  // profile 时再读主线程的 cycles / instructions / LLC misses（perf_event_open，打不开就跳过）
+  bool perf_counters{false};
+};
+
+// run() 的汇总结果
+struct RunStats {
+  std::size_t batches{0};
+  std::size_t events{0};
+  std::size_t fills{0};
+  std::size_t prisk_rejects{0};
+  double final_equity{0.0}; // cash + pos * mid，起点为 0 => 即 PnL（价格单位 * qty）
+  double max_drawdown{0.0}; // equity 峰值回撤：每次 barrier 归约后（equity 唯一会变的时刻）都更新
+  std::uint64_t fill_digest{0};
+  double wall_s{0.0};
+};
+
+// 一个 symbol 的 fills 链（FNV-1a）：顺序敏感
+inline std::uint64_t fill_digest_mix(std::uint64_t h, std::size_t sym_idx, const bt::FillEvent& f) {
+  auto mix = [&h](std::uint64_t v) {
+    for (int k = 0; k < 8; ++k) {
+      h ^= (v >> (8 * k)) & 0xffu;
+      h *= 0x100000001b3ULL;
+    }
+  };
+  mix(sym_idx);
+  mix(static_cast<std::uint64_t>(f.ts_ns));
+  mix(static_cast<std::uint64_t>(f.order_id));
+  mix(static_cast<std::uint64_t>(f.side));
+  mix(static_cast<std::uint64_t>(f.price));
+  mix(static_cast<std::uint64_t>(f.qty));
+  return h;
+}
+
+constexpr std::uint64_t kFillDigestSeed = 0xcbf29ce484222325ULL;
+
+// fills 摘要，串行 / pipelined / lane / 分片对账用：每个 symbol 一条 fill_digest_mix 链，
+// 总摘要 = 各链终值 fmix64 之后求和（mod 2^64）
+// - 同一 symbol 内顺序敏感；symbol 之间谁先归约不影响结果
+// - 链里混的是全局 sym_idx（sym_base + 分片内下标）=> 各分片摘要之和（combine）即单进程的值，与分片数无关
+class FillDigest {
+public:
+  void reset(std::size_t n_syms, std::size_t sym_base = 0) {
+    chain_.assign(n_syms, kFillDigestSeed);
+    sym_base_ = sym_base;
+    total_ = static_cast<std::uint64_t>(n_syms) * fmix(kFillDigestSeed);
+  }
+
+  void add(std::size_t sym_idx, const bt::FillEvent& f) {
+    auto& c = chain_[sym_idx];
+    total_ -= fmix(c);
+    c = fill_digest_mix(c, sym_base_ + sym_idx, f);
+    total_ += fmix(c);
+  }
+
+  std::uint64_t value() const { return total_; }
+  std::size_t n_syms() const { return chain_.size(); }
+
+  static std::uint64_t combine(std::uint64_t a, std::uint64_t b) { return a + b; }
+
+  void save(q::ser::Writer& w) const {
+    w.put_vec(chain_);
+    w.put(total_);
+  }
+  void load(q::ser::Reader& r) {
+    r.get_vec(chain_);
+    r.get(total_);
+  }
+
+private:
+  // murmur3 fmix64：链值求和之前先打散
+  static std::uint64_t fmix(std::uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  std::vector<std::uint64_t> chain_;
+  std::size_t sym_base_{0};
+  std::uint64_t total_{0};
 };
 
 class MultiSymbolEngine {
@@ -26,16 +140,24 @@ public:
   MultiSymbolEngine(std::size_t n_symbols,
                     EngineConfig cfg,
                     const bt::ExecConfig& exec_cfg,
-                    const bt::RiskConfig& risk_cfg)
+                    const bt::RiskConfig& risk_cfg,
+                    const PortfolioRiskConfig& prisk_cfg = {})
       : n_(n_symbols),
+        cfg_(cfg),
         pool_(cfg.n_workers),
         ctx_(n_),
         portfolio_(n_),
-        mvs_(n_),
+        prisk_(prisk_cfg, n_),
+        snap_(n_),
         per_sym_bucket_(n_),
         per_sym_cancel_cmds_(n_),
         per_sym_submit_cmds_(n_),
-        worker_syms_(pool_.size()) {
+        owner_(n_),
+        sym_cost_(n_, 0),
+        track_cost_(cfg.rebalance_every > 0 && pool_.size() > 1),
+        worker_syms_(pool_.size()),
+        steal_(std::make_unique<StealCursor[]>(pool_.size())),
+        wout_(std::make_unique<WorkerOut[]>(pool_.size())) {
 
     for (auto& c : ctx_) {
       c.set_exec_config(exec_cfg);
@@ -43,134 +165,673 @@ public:
     }
 
     for (std::size_t i = 0; i < n_; ++i) {
-      worker_syms_[owner_worker(i, pool_.size())].push_back(i);
+      owner_[i] = owner_worker(i, pool_.size());
     }
+    active_wids_.reserve(pool_.size());
+    for (std::size_t w = 0; w < pool_.size(); ++w) wout_[w].risk = prisk_.make_delta();
+    all_syms_.resize(n_);
+    changed_.reserve(n_);
+    std::iota(all_syms_.begin(), all_syms_.end(), std::size_t{0});
   }
 
-  template <class SchedulerT, class StrategyT>
-  void run(SchedulerT& sched, StrategyT& strat) {
+  // 老接口的策略用 strategy_adapters.hpp 里的适配器包一层
+  template <class SchedulerT, BatchedPortfolioStrategy StrategyT>
+  RunStats run(SchedulerT& sched, StrategyT& strat) {
     std::int64_t last_ts = -1;
     std::size_t batches = 0;
     std::size_t events = 0;
     std::size_t fills_cnt = 0;
+    std::size_t prisk_rejects = 0;
+    const auto wall0 = std::chrono::steady_clock::now();
+    fill_digest_.reset(n_, shard_ ? shard_->sym_base() : 0);
 
-    // jobs vectors reused
-    std::vector<std::function<void(std::size_t)>> jobsA(pool_.size());
-    std::vector<std::function<void(std::size_t)>> jobsB(pool_.size());
+    EngineProfile* prof = cfg_.profile ? &profile_ : nullptr;
+    const auto allocs0 = q::alloc::count();
+    if (prof) profile_.reset(pool_.size(), cfg_.perf_counters);
+    for (std::size_t w = 0; w < pool_.size(); ++w) {
+      wout_[w].syms = 0;
+      wout_[w].events = 0;
+    }
 
-    while (sched.has_next()) {
-      auto batch = sched.next_batch_same_ts(); // vector<pair<sym_idx, MarketEvent>>
-      if (batch.empty()) break;
+    double peak_equity = 0.0;
+    double max_dd = 0.0;
+    if (resume_) {
+      batches = resume_->batches;
+      events = resume_->events;
+      fills_cnt = resume_->fills;
+      prisk_rejects = resume_->prisk_rejects;
+      last_ts = resume_->last_ts;
+      peak_equity = resume_->peak_equity;
+      max_dd = resume_->max_dd;
+      fill_digest_ = std::move(resume_->fill_digest);
+    }
+    auto sample_equity = [&]() {
+      const double eq = portfolio_.equity();
+      peak_equity = std::max(peak_equity, eq);
+      max_dd = std::max(max_dd, peak_equity - eq);
+      return eq;
+    };
 
-      const auto ts = batch.front().second.ts_ns;
-      last_ts = ts;
-      ++batches;
-      events += batch.size();
+    // barrier 后主线程：归约各 worker 的汇总增量（O(workers + groups)），
+    // 再按 sym 升序、sym 内按产生顺序回放 fills 摘要与 order updates（同一 batch 的 ts 相同 => (ts, sym, seq) 序），
+    // updates 收成一段、一次交给策略
+    // 只访问本 phase 有输出的 symbol，per-symbol 的组合 / 风控状态已在 worker 里更新过
+    auto merge_outputs = [&]() {
+      out_syms_.clear();
+      for (std::size_t w = 0; w < pool_.size(); ++w) {
+        auto& wo = wout_[w];
+        portfolio_.apply_delta(wo.pf);
+        if (cfg_.enable_portfolio_risk) prisk_.apply_delta(wo.risk);
+        fills_cnt += wo.fills;
+        wo.fills = 0;
+        out_syms_.insert(out_syms_.end(), wo.out_syms.begin(), wo.out_syms.end());
+        wo.out_syms.clear();
+      }
+      std::sort(out_syms_.begin(), out_syms_.end());
+      upd_refs_.clear();
+      for (auto i : out_syms_) {
+        for (auto const& fe : ctx_[i].fills) fill_digest_.add(i, fe);
+        // 策略可以通过 oms->get(order_id)->side 推断是哪一侧的单
+        for (auto const& up : ctx_[i].updates) upd_refs_.push_back(OrderUpdateRef{i, &ctx_[i].oms, &up});
+        if (journal_out_ || journal_in_) {
+          for (auto const& fe : ctx_[i].fills) jbatch_.fills.push_back(JournalBatch::SymFill{i, fe});
+          for (auto const& up : ctx_[i].updates) jbatch_.updates.push_back(JournalBatch::SymUpdate{i, up});
+        }
+      }
+      if (!upd_refs_.empty()) strat.on_order_updates(std::span<const OrderUpdateRef>(upd_refs_));
+      sample_equity(); // equity 增量维护，O(1)
+    };
+
+    // 0) 取下一个同 ts batch (main thread)：scheduler 归并时直接把事件分进 per-symbol bucket，
+    //    不经中间 batch vector；只清上一 batch 用过的 bucket
+    std::int64_t batch_ts = 0;
+    std::size_t batch_events = 0;
+    auto load_batch = [&]() -> bool {
+      QM_TRACE_SCOPE("load_batch");
+      PhaseTimer pt(prof, Phase::Load);
+      if (!sched.has_next()) return false;
+
+      for (auto i : touched_) per_sym_bucket_[i].clear();
+      touched_.clear();
+      batch_events = sched.next_batch_into([this](std::size_t sym_idx, const q::market::MarketEvent& e) {
+        auto& bucket = per_sym_bucket_[sym_idx];
+        if (bucket.empty()) touched_.push_back(sym_idx);
+        bucket.push_back(e);
+        if (track_cost_) ++sym_cost_[sym_idx];
+      });
+      if (batch_events == 0) return false;
+      batch_ts = sched.batch_ts();
 
-      // 0) build per-symbol bucket (main thread)
-      for (auto& b : per_sym_bucket_) b.clear();
-      for (auto const& it : batch) {
-        per_sym_bucket_[it.first].push_back(it.second);
+      // 按 sym_idx 升序：barrier 处 fills / updates 的回放顺序与全量扫描时一致
+      std::sort(touched_.begin(), touched_.end());
+      return true;
+    };
+
+    // pipelined：预建 book 的 per-worker job 要活到 join()，所以放在循环外
+    auto prebuild_sym = [this, &batch_ts](std::size_t, std::size_t sym_idx) {
+      ctx_[sym_idx].prebuild_market_events(per_sym_bucket_[sym_idx], batch_ts);
+    };
+    auto prebuild_job = [this, &prebuild_sym](std::size_t wid) { run_worker_syms(wid, prebuild_sym); };
+
+    // checkpoint（batch 边界，worker 都已 join）：主线程写 head / 策略，各 worker 序列化自己的 symbol，
+    // 然后交给后台线程写盘；pipelined 模式下已取出、已预建的下一 batch 也一起存（resume 时不重取）
+    auto save_checkpoint = [&](bool pending) {
+      QM_TRACE_SCOPE("checkpoint");
+      PhaseTimer pt(prof, Phase::Checkpoint);
+      auto& img = ckpt_->acquire();
+      img.batch = batches;
+      img.head.clear();
+      q::ser::Writer w(img.head);
+      w.put(static_cast<std::uint64_t>(n_));
+      w.put(cfg_.pipeline);
+      w.put(static_cast<std::uint64_t>(batches));
+      w.put(static_cast<std::uint64_t>(events));
+      w.put(static_cast<std::uint64_t>(fills_cnt));
+      w.put(static_cast<std::uint64_t>(prisk_rejects));
+      w.put(last_ts);
+      w.put(peak_equity);
+      w.put(max_dd);
+      fill_digest_.save(w);
+      w.put(static_cast<std::uint64_t>(rebalances_));
+      w.put_vec(owner_);
+      w.put_vec(sym_cost_);
+      w.put(static_cast<std::uint64_t>(n_));
+      for (std::size_t i = 0; i < n_; ++i) w.put(static_cast<std::uint64_t>(sched.cursor(i)));
+      portfolio_.save(w);
+      prisk_.save(w);
+      w.put(pending);
+      if (pending) {
+        w.put(batch_ts);
+        w.put(static_cast<std::uint64_t>(batch_events));
+        w.put_vec(touched_);
+        for (auto i : touched_) w.put_vec(per_sym_bucket_[i]);
       }
 
-      // ====================== Phase A: Market ======================
-      for (std::size_t wid = 0; wid < pool_.size(); ++wid) {
-        jobsA[wid] = [this, ts](std::size_t wid_) {
-          for (auto sym_idx : worker_syms_[wid_]) {
-            auto& bucket = per_sym_bucket_[sym_idx];
-            if (bucket.empty()) continue;
-            ctx_[sym_idx].process_market_events(bucket, ts);
-            // ctx_[sym_idx].last_mv is ready
-          }
-        };
+      img.strat.clear();
+      if constexpr (requires(q::ser::Writer& sw) { strat.save(sw); }) {
+        q::ser::Writer sw(img.strat);
+        strat.save(sw);
       }
-      pool_.run_all(jobsA);
 
-      // barrier A -> main thread: apply fills + updates, build mvs snapshot
-      for (std::size_t i = 0; i < n_; ++i) {
-        mvs_[i] = ctx_[i].last_mv;
+      img.syms.resize(n_);
+      dispatch(Phase::Checkpoint, all_syms_, n_, [this, &img](std::size_t, std::size_t sym_idx) {
+        img.syms[sym_idx].clear();
+        q::ser::Writer sw(img.syms[sym_idx]);
+        ctx_[sym_idx].save(sw);
+      });
+      ckpt_->submit(img);
+    };
 
-        for (auto const& fe : ctx_[i].fills) {
-          portfolio_.apply_fill(i, fe);
-          ++fills_cnt;
+    // 分片运行：每段结束向 coordinator 报告 接下来有事件的 ts（当前已取出的 batch + scheduler 预读的）与本分片的组合汇总
+    auto report_shard = [&](bool more) {
+      local_agg_.equity = portfolio_.equity_int();
+      local_agg_.gross = prisk_.gross_notional();
+      local_agg_.net = prisk_.net_notional();
+      local_agg_.group_gross.assign(prisk_.group_grosses().begin(), prisk_.group_grosses().end());
+      local_agg_.killed = prisk_.killed();
+      shard_ts_.clear();
+      bool beyond = false;
+      if (more) {
+        shard_ts_.push_back(batch_ts);
+        if constexpr (requires { sched.ahead(); }) {
+          for (std::size_t k = 0; k < sched.ahead(); ++k) shard_ts_.push_back(sched.ahead_ts(k));
+          beyond = sched.more();
+        } else {
+          beyond = sched.has_next();
         }
-        for (auto const& up : ctx_[i].updates) {
-          strat.on_order_updated(i, ctx_[i].oms, up);
+      }
+      shard_->report(shard_ts_, beyond, local_agg_);
+    };
+
+    bool have = false;
+    if (resume_) {
+      // 游标 / 策略在这里恢复；symbol / 组合状态已在 resume_from 里载入
+      sched.seek(resume_->cursors);
+      if constexpr (requires(q::ser::Reader& sr) { strat.load(sr); }) {
+        if (!resume_->strat.empty()) {
+          q::ser::Reader sr(resume_->strat);
+          strat.load(sr);
+          if (!sr.ok()) std::cerr << "checkpoint: strategy state unreadable, strategy restarts cold\n";
+        }
+      } else {
+        std::cerr << "checkpoint: strategy has no save / load hook, strategy restarts cold\n";
+      }
+      if (cfg_.pipeline) {
+        have = resume_->pending;
+        batch_ts = resume_->pending_ts;
+        batch_events = resume_->pending_events;
+      } else {
+        have = load_batch();
+      }
+      resume_.reset();
+    } else {
+      have = load_batch();
+      if (cfg_.pipeline && have) dispatch(Phase::Prebuild, touched_, batch_events, prebuild_sym);
+    }
+
+    // 分片运行：coordinator 放行的每个全局 ts 都跑一轮（本分片数据跑完之后也是），直到收到空的一段；
+    // 本分片在该 ts 没有事件时 local = false：跳过 Phase A，策略 / 下单照常（与单进程里没被触及的 symbol 一样）
+    // 其余分片的汇总每段更新一次
+    assert(!(shard_ && cfg_.pipeline));
+    while (have || shard_) {
+      auto ts = batch_ts;
+      bool local = have;
+      if (shard_) {
+        if (shard_->window_done()) {
+          report_shard(have);
+          if (!shard_->await()) {
+            std::cerr << "shard: lost coordinator after ts=" << last_ts << "\n";
+            break;
+          }
+          if (shard_->finished()) break;
+          prisk_.set_remote(shard_->remote());
+        }
+        ts = shard_->next_ts();
+        if (have && ts > batch_ts) {
+          std::cerr << "shard: coordinator skipped ts=" << batch_ts << "\n";
+          break;
+        }
+        local = have && ts == batch_ts;
+      }
+      last_ts = ts;
+      ++batches;
+      if (local) events += batch_events;
+      QM_TRACE_BATCH(batches);
+
+      // ====================== Phase A: Market ======================
+      // 处理 symbol 的线程把 last_mv 直接写进 snap_ 自己那一格（未触及的 symbol 视图不变）
+      snap_.clear_dirty();
+      if (cfg_.pipeline) {
+        QM_TRACE_SCOPE("phase_a");
+        PhaseTimer pt(prof, Phase::MarketA);
+        // book 已在上一轮预建好，这里只按 staged 视图回放撮合
+        dispatch(Phase::MarketA, touched_, batch_events, [this](std::size_t wid, std::size_t sym_idx) {
+          if (cfg_.profile) wout_[wid].events += per_sym_bucket_[sym_idx].size();
+          ctx_[sym_idx].execute_staged();
+          publish_local(wid, sym_idx, snap_.set(sym_idx, ctx_[sym_idx].last_mv));
+        });
+      } else if (local) {
+        QM_TRACE_SCOPE("phase_a");
+        PhaseTimer pt(prof, Phase::MarketA);
+        dispatch(Phase::MarketA, touched_, batch_events, [this, ts](std::size_t wid, std::size_t sym_idx) {
+          if (cfg_.profile) wout_[wid].events += per_sym_bucket_[sym_idx].size();
+          ctx_[sym_idx].process_market_events(per_sym_bucket_[sym_idx], ts);
+          publish_local(wid, sym_idx, snap_.set(sym_idx, ctx_[sym_idx].last_mv));
+        });
+      }
+
+      // barrier A -> main thread: 归约 + 回放 fills 摘要 / updates
+      {
+        QM_TRACE_SCOPE("merge_a");
+        PhaseTimer pt(prof, Phase::MergeA);
+        merge_outputs();
+      }
+      // equity 是增量维护的（O(1)），回撤熔断每 batch 检查一次
+      // 分片运行时回撤按全局 equity（本分片 + 其余分片）算
+      if (cfg_.enable_portfolio_risk) {
+        prisk_.on_equity(portfolio_.equity() + (shard_ ? static_cast<double>(shard_->remote().equity) : 0.0));
+      }
+
+      // pipelined：先取下一 batch 并让 worker 开始预建 book，与下面的策略 / 下单准备重叠
+      bool prebuild_pending = false;
+      std::uint64_t prebuild_t0 = 0;
+      if (cfg_.pipeline) {
+        have = load_batch();
+        if (have) {
+          if (assign_workers(touched_, batch_events)) {
+            if (prof) prebuild_t0 = EngineProfile::now_ns();
+            pool_.start_on(active_wids_, prebuild_job);
+            prebuild_pending = true;
+          } else {
+            PhaseTimer pt(prof, Phase::Prebuild);
+            if (prof) prof->add_inline(Phase::Prebuild);
+            for (auto i : touched_) prebuild_sym(std::size_t{0}, i);
+          }
         }
       }
 
       // ====================== Strategy Decision ======================
-      auto decision = strat.on_batch(mvs_, portfolio_);
+      // replay：不跑策略，命令取自 journal（记录的是已过组合风控的命令，不再过一次）
+      PortfolioDecision decision;
+      if (journal_in_) {
+        if (const auto* jb = journal_in_->commands(batches)) {
+          decision.cancels = jb->cancels;
+          decision.submits = jb->submits;
+        }
+      } else {
+        QM_TRACE_SCOPE("strategy");
+        PhaseTimer pt(prof, Phase::Strategy);
+        changed_.clear();
+        snap_.for_each_dirty([this](std::size_t i) { changed_.push_back(i); });
+        decision = strat.on_batch(StrategyBatch{ts, snap_, changed_, portfolio_, shard_ ? &shard_->remote() : nullptr});
+      }
+      const bool check_prisk = cfg_.enable_portfolio_risk && !journal_in_;
 
       // 1) build per-symbol command lists (main thread)
-      for (auto& v : per_sym_cancel_cmds_) v.clear();
-      for (auto& v : per_sym_submit_cmds_) v.clear();
+      std::size_t n_cmds = 0;
+      {
+        QM_TRACE_SCOPE("risk_cmds");
+        PhaseTimer pt(prof, Phase::RiskCmds);
+        for (auto i : cmd_syms_) {
+          per_sym_cancel_cmds_[i].clear();
+          per_sym_submit_cmds_[i].clear();
+        }
+        cmd_syms_.clear();
 
-      for (auto const& c : decision.cancels) {
-        if (c.sym_idx >= n_) continue;
-        per_sym_cancel_cmds_[c.sym_idx].push_back(typename SymbolContext::CancelCmd{c.order_id});
+        for (auto const& c : decision.cancels) {
+          if (c.sym_idx >= n_) continue;
+          mark_cmd_sym(c.sym_idx);
+          per_sym_cancel_cmds_[c.sym_idx].push_back(typename SymbolContext::CancelCmd{c.order_id});
+          if (journal_out_) jbatch_.cancels.push_back(c);
+          if (track_cost_) ++sym_cost_[c.sym_idx];
+          ++n_cmds;
+        }
+        assert(portfolio_.consistent_with(snap_));
+        if (cfg_.enable_portfolio_risk) assert(prisk_.consistent_with(portfolio_, snap_));
+        for (auto const& s : decision.submits) {
+          if (s.sym_idx >= n_) continue;
+          if (check_prisk && !prisk_.pre_trade_check(s).ok) {
+            ++prisk_rejects;
+            continue;
+          }
+          mark_cmd_sym(s.sym_idx);
+          per_sym_submit_cmds_[s.sym_idx].push_back(typename SymbolContext::SubmitCmd{s.req});
+          if (journal_out_) jbatch_.submits.push_back(s);
+          if (track_cost_) ++sym_cost_[s.sym_idx];
+          ++n_cmds;
+        }
+        std::sort(cmd_syms_.begin(), cmd_syms_.end());
       }
-      for (auto const& s : decision.submits) {
-        if (s.sym_idx >= n_) continue;
-        per_sym_submit_cmds_[s.sym_idx].push_back(typename SymbolContext::SubmitCmd{s.req});
+
+      if (prebuild_pending) {
+        QM_TRACE_SCOPE("prebuild_join");
+        {
+          PhaseTimer pt(prof, Phase::Prebuild);
+          pool_.join();
+        }
+        // 预建与策略重叠，worker 做完之后的空闲不算 barrier 等待
+        if (prof) account_dispatch(Phase::Prebuild, prebuild_t0, false);
       }
 
       // ====================== Phase B: Orders ======================
-      for (std::size_t wid = 0; wid < pool_.size(); ++wid) {
-        jobsB[wid] = [this](std::size_t wid_) {
-          for (auto sym_idx : worker_syms_[wid_]) {
-            auto& cancels = per_sym_cancel_cmds_[sym_idx];
-            auto& submits = per_sym_submit_cmds_[sym_idx];
-            if (cancels.empty() && submits.empty()) continue;
-
-            // 这里你也可以加入 symbol risk（因为它只读 portfolio 的 pos，需要主线程提供 snapshot pos）
-            ctx_[sym_idx].process_commands(cancels, submits);
-          }
-        };
+      {
+        QM_TRACE_SCOPE("phase_b");
+        PhaseTimer pt(prof, Phase::OrdersB);
+        dispatch(Phase::OrdersB, cmd_syms_, n_cmds, [this](std::size_t wid, std::size_t sym_idx) {
+          // 这里你也可以加入 symbol risk（因为它只读 portfolio 的 pos，需要主线程提供 snapshot pos）
+          ctx_[sym_idx].process_commands(per_sym_cancel_cmds_[sym_idx], per_sym_submit_cmds_[sym_idx]);
+          publish_local(wid, sym_idx, false);
+        });
       }
-      pool_.run_all(jobsB);
 
-      // barrier B -> main thread: apply fills + updates (order acks/cancel req + immediate fills)
-      for (std::size_t i = 0; i < n_; ++i) {
-        for (auto const& fe : ctx_[i].fills) {
-          portfolio_.apply_fill(i, fe);
-          ++fills_cnt;
-        }
-        for (auto const& up : ctx_[i].updates) {
-          // submit ack 的 tracking（如果你策略有这个接口）
-          // 你也可以在 strategy.on_order_updated 内部通过 oms.get(order_id)->side 来推断
-          strat.on_order_updated(i, ctx_[i].oms, up);
+      // barrier B -> main thread: 归约 + 回放 (order acks/cancel req + immediate fills)
+      {
+        QM_TRACE_SCOPE("merge_b");
+        PhaseTimer pt(prof, Phase::MergeB);
+        merge_outputs();
+      }
+
+      // journal：record 写出本 batch（有动作才写）；replay 逐 batch 对账，分叉时可提前结束
+      if (journal_out_ || journal_in_) {
+        jbatch_.batch = batches;
+        jbatch_.ts = ts;
+        jbatch_.fill_digest = fill_digest_.value();
+        if (journal_out_ && !jbatch_.empty()) journal_out_->write(jbatch_);
+        if (journal_in_) journal_in_->verify(jbatch_);
+        jbatch_.clear();
+        if (journal_in_ && journal_in_->diverged() && journal_in_->stop_on_divergence) break;
+      }
+
+      if (cfg_.progress_every > 0 && (batches % cfg_.progress_every) == 0) {
+        const double eq = portfolio_.equity();
+        if (!cfg_.quiet) {
+          std::cout << "ts=" << last_ts
+                    << " batches=" << batches
+                    << " events=" << events
+                    << " fills=" << fills_cnt
+                    << " equity=" << eq
+                    << "\n";
         }
       }
 
-      if ((batches % 1000) == 0) {
-        std::cout << "ts=" << last_ts
-                  << " batches=" << batches
-                  << " events=" << events
-                  << " fills=" << fills_cnt
-                  << " equity=" << portfolio_.equity(mvs_)
-                  << "\n";
+      // 两个 phase 都已 join，此时换 owner 安全（barrier 保证 happens-before）
+      if (cfg_.rebalance_every > 0 && (batches % cfg_.rebalance_every) == 0) {
+        QM_TRACE_SCOPE("rebalance");
+        PhaseTimer pt(prof, Phase::Rebalance);
+        rebalance();
       }
+
+      if (ckpt_ && ckpt_->due(batches)) save_checkpoint(cfg_.pipeline && have);
+
+      if (!cfg_.pipeline && local) have = load_batch();
+      if (shard_) shard_->end_round(portfolio_.equity_int());
     }
+    fill_count_ = fills_cnt;
+    if (ckpt_) ckpt_->flush();
+    if (journal_in_) journal_in_->finish();
 
+    RunStats rs;
+    rs.batches = batches;
+    rs.events = events;
+    rs.fills = fills_cnt;
+    rs.prisk_rejects = prisk_rejects;
+    rs.final_equity = sample_equity();
+    rs.max_drawdown = max_dd;
+    rs.fill_digest = fill_digest_.value();
+    rs.wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall0).count();
+    if (prof) {
+      for (std::size_t w = 0; w < pool_.size(); ++w) {
+        profile_.worker(w).syms = wout_[w].syms;
+        profile_.worker(w).events = wout_[w].events;
+      }
+      profile_.finish(batches, events, static_cast<std::uint64_t>(rs.wall_s * 1e9), q::alloc::count() - allocs0);
+    }
+    if (cfg_.quiet) return rs;
+
+    const double wall_s = rs.wall_s;
     std::cout << "DONE ts=" << last_ts
               << " batches=" << batches
               << " events=" << events
               << " fills=" << fills_cnt
-              << " equity=" << portfolio_.equity(mvs_)
+              << " equity=" << rs.final_equity;
+    if (cfg_.enable_portfolio_risk) {
+      std::cout << " gross=" << prisk_.gross_notional()
+                << " net=" << prisk_.net_notional()
+                << " prisk_rejects=" << prisk_rejects;
+    }
+    if (cfg_.rebalance_every > 0) std::cout << " rebalances=" << rebalances_;
+    if (journal_in_) {
+      std::cout << " replay=" << (journal_in_->diverged() ? "diverged" : "ok");
+      if (journal_in_->diverged()) std::cout << " first_divergent_batch=" << journal_in_->first_divergence();
+    }
+    if constexpr (requires { sched.io_stall_ns(); }) {
+      std::cout << " io_stall_ms=" << static_cast<double>(sched.io_stall_ns()) / 1e6;
+    }
+    std::cout << " fill_digest=" << std::hex << fill_digest_.value() << std::dec
+              << " wall_s=" << wall_s
+              << " batches_per_s=" << (wall_s > 0 ? static_cast<double>(batches) / wall_s : 0.0)
               << "\n";
+    return rs;
   }
 
   Portfolio& portfolio() { return portfolio_; }
+  const MarketSnapshot& snapshot() const { return snap_; }
+  // 最近一次 run() 的 profile（EngineConfig::profile）
+  const EngineProfile& profile() const { return profile_; }
+  const PortfolioRisk& portfolio_risk() const { return prisk_; }
+
+  // 最近一次 run() 的 fills 摘要 / 笔数
+  std::uint64_t fill_digest() const { return fill_digest_.value(); }
+  std::size_t fill_count() const { return fill_count_; }
+
+  std::size_t owner_of(std::size_t sym_idx) const { return owner_[sym_idx]; }
+  std::size_t rebalances() const { return rebalances_; }
+
+  // event-sourced 日志（不拥有，run() 期间须存活；nullptr = 关闭）：
+  // - set_journal：每个有动作的 batch 记下发给 process_commands 的命令，以及回放顺序的 fills / updates
+  // - set_replay：不跑策略 / 组合风控，按 journal 的命令重放，逐 batch 对账，journal->first_divergence() 即出问题的 batch
+  void set_journal(JournalWriter* w) { journal_out_ = w; }
+  void set_replay(JournalReader* r) { journal_in_ = r; }
+
+  // 周期性 checkpoint（不拥有；nullptr = 关闭）：每 cfg().every_batches 个 batch 在 batch 边界存一份，
+  // 写盘在 CheckpointWriter 的后台线程；run() 返回前等最后一份落盘
+  void set_checkpointer(CheckpointWriter* w) { ckpt_ = w; }
+
+  // 分片运行（不拥有；nullptr = 单进程；不支持 pipeline）：batch 序列由 coordinator 给出的全局 ts 驱动，
+  // 组合风控的 gross / 分组限额与回撤熔断按 本分片 + 其余分片 的汇总检查，策略从 StrategyBatch::remote 看到其余分片的汇总
+  void set_shard(ShardLink* s) { shard_ = s; }
+
+  // 从 checkpoint 恢复：symbol / 组合 / 风控状态立即载入，调度游标与策略状态在下一次 run() 开头恢复，
+  // run() 从存盘时的下一个 batch 接着跑（计数、fill_digest 接上）。须与存盘时同样的 symbol 数和 pipeline 设置；
+  // 返回 false 时 engine 状态不确定，应丢弃重建
+  bool resume_from(const std::string& path) {
+    CheckpointImage img;
+    if (!ckpt::read_file(path, img) || img.syms.size() != n_) return false;
+
+    auto rs = std::make_unique<ResumeState>();
+    q::ser::Reader r(img.head);
+    if (r.get<std::uint64_t>() != n_ || r.get<bool>() != cfg_.pipeline) return false;
+    rs->batches = static_cast<std::size_t>(r.get<std::uint64_t>());
+    rs->events = static_cast<std::size_t>(r.get<std::uint64_t>());
+    rs->fills = static_cast<std::size_t>(r.get<std::uint64_t>());
+    rs->prisk_rejects = static_cast<std::size_t>(r.get<std::uint64_t>());
+    r.get(rs->last_ts);
+    r.get(rs->peak_equity);
+    r.get(rs->max_dd);
+    rs->fill_digest.load(r);
+    rebalances_ = static_cast<std::size_t>(r.get<std::uint64_t>());
+    r.get_vec(owner_);
+    r.get_vec(sym_cost_);
+    if (r.get<std::uint64_t>() != n_ || owner_.size() != n_ || sym_cost_.size() != n_ ||
+        rs->fill_digest.n_syms() != n_) return false;
+    rs->cursors.resize(n_);
+    for (auto& c : rs->cursors) c = static_cast<std::size_t>(r.get<std::uint64_t>());
+    for (auto w : owner_) {
+      if (w >= pool_.size()) return false; // worker 数变了：owner 表作废
+    }
+    portfolio_.load(r);
+    prisk_.load(r);
+    r.get(rs->pending);
+    for (auto i : touched_) per_sym_bucket_[i].clear();
+    touched_.clear();
+    if (rs->pending) {
+      r.get(rs->pending_ts);
+      rs->pending_events = static_cast<std::size_t>(r.get<std::uint64_t>());
+      r.get_vec(touched_);
+      for (auto i : touched_) {
+        if (i >= n_) return false;
+        r.get_vec(per_sym_bucket_[i]);
+      }
+    }
+    if (!r.ok()) return false;
+
+    for (std::size_t i = 0; i < n_; ++i) {
+      q::ser::Reader sr(img.syms[i]);
+      ctx_[i].load(sr);
+      if (!sr.ok()) return false;
+      snap_.set(i, ctx_[i].last_mv);
+    }
+    snap_.clear_dirty();
+    rs->strat = std::move(img.strat);
+    resume_ = std::move(rs);
+    return true;
+  }
 
 private:
+  // worker 侧（处理 sym_idx 的线程）：把本 symbol 的 mark / fills 记进组合与风控的 per-symbol 状态，
+  // 汇总增量累加到本 worker 的 WorkerOut，有输出的 symbol 记下来给 barrier 后回放
+  void publish_local(std::size_t wid, std::size_t sym_idx, bool mid_changed) {
+    auto& wo = wout_[wid];
+    const auto& c = ctx_[sym_idx];
+    if (mid_changed) {
+      const auto mid = snap_.mid()[sym_idx];
+      portfolio_.on_mid_local(sym_idx, mid, wo.pf);
+      if (cfg_.enable_portfolio_risk) prisk_.on_mid_local(sym_idx, mid, wo.risk);
+    }
+    for (auto const& fe : c.fills) {
+      portfolio_.apply_fill_local(sym_idx, fe, wo.pf);
+      if (cfg_.enable_portfolio_risk) prisk_.on_fill_local(sym_idx, fe, wo.risk);
+    }
+    wo.fills += c.fills.size();
+    if (!c.fills.empty() || !c.updates.empty()) wo.out_syms.push_back(sym_idx);
+  }
+
+  void mark_cmd_sym(std::size_t sym_idx) {
+    if (per_sym_cancel_cmds_[sym_idx].empty() && per_sym_submit_cmds_[sym_idx].empty()) {
+      cmd_syms_.push_back(sym_idx);
+    }
+  }
+
+  // syms：升序、不重复的 dirty symbols；按 owner 分到 worker_syms_ / active_wids_
+  // 返回 false 表示不值得唤醒 worker（work 小或只落在一个 worker 上），调用方直接在主线程跑
+  bool assign_workers(const std::vector<std::size_t>& syms, std::size_t work) {
+    if (syms.empty() || pool_.size() == 1 || work <= cfg_.inline_max_work) return false;
+
+    for (auto wid : active_wids_) worker_syms_[wid].clear();
+    active_wids_.clear();
+    for (auto i : syms) {
+      auto& v = worker_syms_[owner_[i]];
+      if (v.empty()) active_wids_.push_back(owner_[i]);
+      v.push_back(i);
+    }
+    if (active_wids_.size() == 1) return false;
+    if (cfg_.enable_stealing && syms.size() >= pool_.size()) {
+      // symbol 足够多：空闲 worker 也唤醒，让它们去偷
+      for (std::size_t wid = 0; wid < pool_.size(); ++wid) {
+        if (worker_syms_[wid].empty()) active_wids_.push_back(wid);
+      }
+    }
+    std::sort(active_wids_.begin(), active_wids_.end());
+    if (cfg_.enable_stealing) {
+      for (auto wid : active_wids_) steal_[wid].next.store(0, std::memory_order_relaxed);
+    }
+    return true;
+  }
+
+  // worker wid 在一个 phase 内的工作：先做自己的列表，开启 stealing 时再去别人的列表认领
+  template <class F>
+  void run_worker_syms(std::size_t wid, F& per_sym) {
+    const std::uint64_t t0 = cfg_.profile ? EngineProfile::now_ns() : 0;
+    auto counted = [this, &per_sym](std::size_t w, std::size_t i) {
+      if (cfg_.profile) ++wout_[w].syms;
+      per_sym(w, i);
+    };
+    if (!cfg_.enable_stealing) {
+      for (auto i : worker_syms_[wid]) counted(wid, i);
+    } else {
+      drain_worker_syms(wid, wid, counted);
+      for (auto v : active_wids_) {
+        if (v != wid) drain_worker_syms(wid, v, counted);
+      }
+    }
+    if (cfg_.profile) wout_[wid].busy_ns = EngineProfile::now_ns() - t0;
+  }
+
+  template <class F>
+  void drain_worker_syms(std::size_t wid, std::size_t owner, F& per_sym) {
+    const auto& list = worker_syms_[owner];
+    auto& next = steal_[owner].next;
+    for (;;) {
+      const auto k = next.fetch_add(1, std::memory_order_relaxed);
+      if (k >= list.size()) return;
+      per_sym(wid, list[k]);
+    }
+  }
+
+  // LPT：按成本降序，每只 symbol 放到当前最轻的 worker；+1 让零成本 symbol 也被摊开
+  void rebalance() {
+    const auto n_w = pool_.size();
+    if (n_w == 1) return;
+    rebalance_order_.resize(n_);
+    std::iota(rebalance_order_.begin(), rebalance_order_.end(), std::size_t{0});
+    std::sort(rebalance_order_.begin(), rebalance_order_.end(), [this](std::size_t a, std::size_t b) {
+      return sym_cost_[a] != sym_cost_[b] ? sym_cost_[a] > sym_cost_[b] : a < b;
+    });
+
+    rebalance_load_.assign(n_w, 0);
+    for (auto i : rebalance_order_) {
+      std::size_t best = 0;
+      for (std::size_t w = 1; w < n_w; ++w) {
+        if (rebalance_load_[w] < rebalance_load_[best]) best = w;
+      }
+      owner_[i] = best;
+      rebalance_load_[best] += sym_cost_[i] + 1;
+      sym_cost_[i] >>= 1;
+    }
+    ++rebalances_;
+  }
+
+  // per_sym(wid, sym_idx)；不唤醒 worker 时主线程按 worker 0 跑
+  template <class F>
+  void dispatch(Phase phase, const std::vector<std::size_t>& syms, std::size_t work, F&& per_sym) {
+    if (!assign_workers(syms, work)) {
+      for (auto i : syms) per_sym(std::size_t{0}, i);
+      if (cfg_.profile) {
+        wout_[0].syms += syms.size();
+        profile_.add_inline(phase);
+      }
+      return;
+    }
+    const std::uint64_t t0 = cfg_.profile ? EngineProfile::now_ns() : 0;
+    pool_.run_on(active_wids_, [this, &per_sym](std::size_t wid) { run_worker_syms(wid, per_sym); });
+    if (cfg_.profile) account_dispatch(phase, t0, true);
+  }
+
+  // 一次分发 join 之后：active_wids_ 各自的 busy_ns 记进 profile
+  void account_dispatch(Phase phase, std::uint64_t t0, bool count_wait) {
+    profile_.add_dispatch(phase, active_wids_, [this](std::size_t w) { return wout_[w].busy_ns; },
+                          EngineProfile::now_ns() - t0, count_wait);
+  }
+
   std::size_t n_;
+  EngineConfig cfg_;
   WorkerPool pool_;
 
   std::vector<SymbolContext> ctx_;
 
   Portfolio portfolio_;
-  std::vector<MarketView> mvs_;
+  PortfolioRisk prisk_;
+  MarketSnapshot snap_;
 
   // per-symbol market events at current ts
   std::vector<std::vector<q::market::MarketEvent>> per_sym_bucket_;
@@ -180,7 +841,74 @@ private:
   std::vector<std::vector<typename SymbolContext::SubmitCmd>> per_sym_submit_cmds_;
 
   // worker ownership table
-  std::vector<std::vector<std::size_t>> worker_syms_;
+  std::vector<std::size_t> owner_;                  // sym_idx -> wid
+  std::vector<std::uint64_t> sym_cost_;             // 上次 rebalance 以来的成本（events + commands，带衰减）
+  bool track_cost_{false};                          // 只有 rebalance 用 sym_cost_；关掉时不计
+  std::vector<std::vector<std::size_t>> worker_syms_; // 本 phase 每个 worker 要处理的 dirty symbols
+  std::vector<std::size_t> active_wids_;
+
+  // stealing：worker_syms_[wid] 的认领游标
+  struct alignas(64) StealCursor {
+    std::atomic<std::size_t> next{0};
+  };
+  std::unique_ptr<StealCursor[]> steal_;
+
+  std::vector<std::size_t> rebalance_order_;
+  std::vector<std::uint64_t> rebalance_load_;
+  std::size_t rebalances_{0};
+
+  // dirty lists（每 batch 重建）
+  std::vector<std::size_t> touched_;  // 有 market event 的 symbol
+  std::vector<std::size_t> cmd_syms_; // 有 cancel / submit 的 symbol
+
+  // 每个 worker 的输出缓冲（独占 cache line）；主线程在 barrier 后归约
+  struct alignas(64) WorkerOut {
+    PortfolioDelta pf;
+    ExposureDelta risk;
+    std::size_t fills{0};
+    std::vector<std::size_t> out_syms; // 本 phase 有 fills / updates 的 symbol
+    // profile：本次分发的忙碌时间，以及本次 run 累计处理的 symbol / market event 数
+    std::uint64_t busy_ns{0};
+    std::uint64_t syms{0};
+    std::uint64_t events{0};
+  };
+  std::unique_ptr<WorkerOut[]> wout_;
+  std::vector<std::size_t> out_syms_;
+  std::vector<OrderUpdateRef> upd_refs_; // 本次 merge 的回报，一次交给策略
+  std::vector<std::size_t> changed_;     // 本 batch 视图有变化的 symbol（升序）
+  EngineProfile profile_;
+
+  FillDigest fill_digest_;
+  std::size_t fill_count_{0};
+
+  JournalWriter* journal_out_{nullptr};
+  JournalReader* journal_in_{nullptr};
+  JournalBatch jbatch_; // 本 batch 的命令 / 回报（journal 打开时才填）
+
+  CheckpointWriter* ckpt_{nullptr};
+  std::vector<std::size_t> all_syms_; // checkpoint 时按 owner 分发全部 symbol
+
+  ShardLink* shard_{nullptr};
+  PortfolioAggregates local_agg_; // 报告给 coordinator 的本分片汇总（复用 group_gross 的容量）
+  std::vector<std::int64_t> shard_ts_; // 报告给 coordinator 的接下来的 ts
+
+  // resume_from 载入、下一次 run() 开头消费的部分
+  struct ResumeState {
+    std::size_t batches{0};
+    std::size_t events{0};
+    std::size_t fills{0};
+    std::size_t prisk_rejects{0};
+    std::int64_t last_ts{-1};
+    double peak_equity{0.0};
+    double max_dd{0.0};
+    FillDigest fill_digest;
+    std::vector<std::size_t> cursors;
+    std::string strat;
+    bool pending{false}; // pipelined：已取出并预建好的下一 batch 在 touched_ / per_sym_bucket_ 里
+    std::int64_t pending_ts{0};
+    std::size_t pending_events{0};
+  };
+  std::unique_ptr<ResumeState> resume_;
 };
 
 } // namespace bt3
@@ -0,0 +1,144 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace bt3 {
+
+struct IoPrefetchConfig {
+  std::size_t n_threads{1};
+  std::size_t budget_bytes{256u << 20}; // 预读块（在读 + 已读未消费）总内存上限
+};
+
+// 后台 I/O 线程池：按 priority（下一次需要这块数据的逻辑时间，越小越先）执行预读请求
+// - 请求是 (ctx, fn) thunk：fn(ctx) 返回 false 表示请求在开始前已被取消（调用方自己同步读了）
+// - 每个请求预占 bytes 的预算，预算不够时 I/O 线程等，直到消费方 release()
+// - 锁只在提交 / 取请求时持有；块读取本身不持锁
+// - 生命周期：prefetcher 必须比挂在它上面的 replay 活得久（replay 析构时 forget 自己的请求）
+class IoPrefetcher {
+public:
+  using Fn = bool (*)(void*);
+
+  explicit IoPrefetcher(IoPrefetchConfig cfg = {}) : cfg_(cfg) {
+    const auto n = cfg_.n_threads ? cfg_.n_threads : 1;
+    threads_.reserve(n);
+    for (std::size_t i = 0; i < n; ++i) threads_.emplace_back([this]() { loop(); });
+  }
+
+  ~IoPrefetcher() {
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : threads_) if (t.joinable()) t.join();
+  }
+
+  IoPrefetcher(const IoPrefetcher&) = delete;
+  IoPrefetcher& operator=(const IoPrefetcher&) = delete;
+
+  void submit(std::int64_t prio_ts, std::size_t bytes, void* ctx, Fn fn) {
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      q_.push_back(Req{prio_ts, next_seq_++, bytes, ctx, fn});
+      std::push_heap(q_.begin(), q_.end(), Cmp{});
+    }
+    cv_.notify_one();
+  }
+
+  // 丢掉 ctx 还在排队的请求，并等已被 I/O 线程取走的 ctx 请求返回；之后 ctx 可以析构
+  void forget(void* ctx) {
+    std::unique_lock<std::mutex> lk(mu_);
+    q_.erase(std::remove_if(q_.begin(), q_.end(), [ctx](const Req& r) { return r.ctx == ctx; }), q_.end());
+    std::make_heap(q_.begin(), q_.end(), Cmp{});
+    cv_.wait(lk, [this, ctx]() { return std::find(running_.begin(), running_.end(), ctx) == running_.end(); });
+  }
+
+  // 消费方用完一块预读数据后归还预算
+  void release(std::size_t bytes) {
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      used_bytes_ -= bytes;
+    }
+    cv_.notify_all();
+  }
+
+  std::size_t budget_bytes() const { return cfg_.budget_bytes; }
+
+  struct Stats {
+    std::uint64_t loads{0};
+    std::uint64_t cancelled{0};
+    std::size_t peak_bytes{0};
+  };
+  Stats stats() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return stats_;
+  }
+
+private:
+  struct Req {
+    std::int64_t prio_ts;
+    std::uint64_t seq; // 同 prio 先到先服务
+    std::size_t bytes;
+    void* ctx;
+    Fn fn;
+  };
+  struct Cmp {
+    bool operator()(const Req& a, const Req& b) const {
+      if (a.prio_ts != b.prio_ts) return a.prio_ts > b.prio_ts;
+      return a.seq > b.seq;
+    }
+  };
+
+  // 至少允许一块在读，避免 budget 小于单块时永远不动
+  bool fits(std::size_t bytes) const { return used_bytes_ == 0 || used_bytes_ + bytes <= cfg_.budget_bytes; }
+
+  void loop() {
+    for (;;) {
+      Req r{};
+      {
+        std::unique_lock<std::mutex> lk(mu_);
+        cv_.wait(lk, [this]() { return stop_ || (!q_.empty() && fits(q_.front().bytes)); });
+        if (stop_) return;
+        std::pop_heap(q_.begin(), q_.end(), Cmp{});
+        r = q_.back();
+        q_.pop_back();
+        used_bytes_ += r.bytes;
+        if (used_bytes_ > stats_.peak_bytes) stats_.peak_bytes = used_bytes_;
+        running_.push_back(r.ctx);
+      }
+
+      const bool ran = r.fn(r.ctx);
+
+      {
+        std::lock_guard<std::mutex> lk(mu_);
+        running_.erase(std::find(running_.begin(), running_.end(), r.ctx));
+        if (ran) {
+          ++stats_.loads;
+        } else {
+          ++stats_.cancelled;
+          used_bytes_ -= r.bytes;
+        }
+      }
+      cv_.notify_all();
+    }
+  }
+
+private:
+  IoPrefetchConfig cfg_;
+  mutable std::mutex mu_;
+  std::condition_variable cv_;
+  std::vector<Req> q_; // heap，堆顶 = prio 最小
+  std::vector<void*> running_; // 已取走、fn 还没返回的 ctx
+  std::uint64_t next_seq_{0};
+  std::size_t used_bytes_{0};
+  bool stop_{false};
+  Stats stats_{};
+  std::vector<std::thread> threads_;
+};
+
+} // namespace bt3
@@ -0,0 +1,321 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "backtest/orders.hpp"
+#include "backtest3/strategy_portfolio.hpp" // CancelIntent / OrderIntent / PortfolioDecision
+
+namespace bt3 {
+
+// 一个 batch 的决策与结果（只记有动作的 batch）：
+// - cancels / submits：真正下发给 SymbolContext::process_commands 的命令（submits 已过组合风控）
+// - fills / updates：barrier 后按 (sym, seq) 回放的顺序；OrderUpdate::reason 不落盘
+// - fill_digest：本 batch 结束时的累计 fills 摘要
+struct JournalBatch {
+  struct SymFill {
+    std::size_t sym_idx{0};
+    bt::FillEvent f{};
+  };
+  struct SymUpdate {
+    std::size_t sym_idx{0};
+    bt::OrderUpdate up{};
+  };
+
+  std::uint64_t batch{0}; // run() 内从 1 开始的 batch 序号
+  std::int64_t ts{0};
+  std::uint64_t fill_digest{0};
+  std::vector<CancelIntent> cancels;
+  std::vector<OrderIntent> submits;
+  std::vector<SymFill> fills;
+  std::vector<SymUpdate> updates;
+
+  bool empty() const { return cancels.empty() && submits.empty() && fills.empty() && updates.empty(); }
+
+  void clear() {
+    cancels.clear();
+    submits.clear();
+    fills.clear();
+    updates.clear();
+  }
+};
+
+// ===================== binary =====================
+// 16B header（magic + version + n_syms）；之后每个 batch：40B batch 头 + 各类定长 32B 记录，小端
+namespace journal {
+
+inline constexpr char kMagic[8] = {'B', 'T', '3', 'J', 'R', 'N', 'L', '1'};
+inline constexpr std::uint32_t kVersion = 2; // 2：fill_digest 按 symbol 链求和（FillDigest）
+inline constexpr std::size_t kHeaderBytes = 16;
+inline constexpr std::size_t kBatchBytes = 40;
+inline constexpr std::size_t kRecordBytes = 32;
+
+template <class T>
+inline void put(char* out, std::size_t off, T v) { std::memcpy(out + off, &v, sizeof(T)); }
+template <class T>
+inline T get(const char* in, std::size_t off) {
+  T v{};
+  std::memcpy(&v, in + off, sizeof(T));
+  return v;
+}
+
+// batch(8) ts(8) fill_digest(8) n_cancels(4) n_submits(4) n_fills(4) n_updates(4)
+inline void encode_batch(const JournalBatch& b, char* out) {
+  put(out, 0, b.batch);
+  put(out, 8, b.ts);
+  put(out, 16, b.fill_digest);
+  put(out, 24, static_cast<std::uint32_t>(b.cancels.size()));
+  put(out, 28, static_cast<std::uint32_t>(b.submits.size()));
+  put(out, 32, static_cast<std::uint32_t>(b.fills.size()));
+  put(out, 36, static_cast<std::uint32_t>(b.updates.size()));
+}
+
+// cancel: sym(4) pad(4) order_id(8) pad(16)
+inline void encode(const CancelIntent& c, char* out) {
+  std::memset(out, 0, kRecordBytes);
+  put(out, 0, static_cast<std::uint32_t>(c.sym_idx));
+  put(out, 8, c.order_id);
+}
+inline CancelIntent decode_cancel(const char* in) {
+  return CancelIntent{get<std::uint32_t>(in, 0), get<std::int64_t>(in, 8)};
+}
+
+// submit: sym(4) type(1) side(1) tif(1) pad(1) qty(8) limit_px(8) pad(8)
+inline void encode(const OrderIntent& s, char* out) {
+  std::memset(out, 0, kRecordBytes);
+  put(out, 0, static_cast<std::uint32_t>(s.sym_idx));
+  out[4] = static_cast<char>(s.req.type);
+  out[5] = static_cast<char>(s.req.side);
+  out[6] = static_cast<char>(s.req.tif);
+  put(out, 8, s.req.qty);
+  put(out, 16, s.req.limit_px);
+}
+inline OrderIntent decode_submit(const char* in) {
+  OrderIntent s;
+  s.sym_idx = get<std::uint32_t>(in, 0);
+  s.req.type = static_cast<bt::OrderType>(in[4]);
+  s.req.side = static_cast<bt::Side>(in[5]);
+  s.req.tif = static_cast<bt::TimeInForce>(in[6]);
+  s.req.qty = get<std::int64_t>(in, 8);
+  s.req.limit_px = get<std::int64_t>(in, 16);
+  return s;
+}
+
+// fill 占两条记录：sym(4) side(1) pad(3) ts(8) order_id(8) pad(8) | price(8) qty(8) pad(16)
+inline void encode(const JournalBatch::SymFill& f, char* out) {
+  std::memset(out, 0, 2 * kRecordBytes);
+  put(out, 0, static_cast<std::uint32_t>(f.sym_idx));
+  out[4] = static_cast<char>(f.f.side);
+  put(out, 8, f.f.ts_ns);
+  put(out, 16, f.f.order_id);
+  put(out, kRecordBytes + 0, f.f.price);
+  put(out, kRecordBytes + 8, f.f.qty);
+}
+inline JournalBatch::SymFill decode_fill(const char* in) {
+  JournalBatch::SymFill f;
+  f.sym_idx = get<std::uint32_t>(in, 0);
+  f.f.side = static_cast<bt::Side>(in[4]);
+  f.f.ts_ns = get<std::int64_t>(in, 8);
+  f.f.order_id = get<std::int64_t>(in, 16);
+  f.f.price = get<std::int64_t>(in, kRecordBytes + 0);
+  f.f.qty = get<std::int64_t>(in, kRecordBytes + 8);
+  return f;
+}
+
+// update: sym(4) status(1) pad(3) ts(8) order_id(8) pad(8)
+inline void encode(const JournalBatch::SymUpdate& u, char* out) {
+  std::memset(out, 0, kRecordBytes);
+  put(out, 0, static_cast<std::uint32_t>(u.sym_idx));
+  out[4] = static_cast<char>(u.up.status);
+  put(out, 8, u.up.ts_ns);
+  put(out, 16, u.up.order_id);
+}
+inline JournalBatch::SymUpdate decode_update(const char* in) {
+  JournalBatch::SymUpdate u;
+  u.sym_idx = get<std::uint32_t>(in, 0);
+  u.up.status = static_cast<bt::OrderStatus>(in[4]);
+  u.up.ts_ns = get<std::int64_t>(in, 8);
+  u.up.order_id = get<std::int64_t>(in, 16);
+  return u;
+}
+
+inline void encode_header(std::uint32_t n_syms, char* out) {
+  std::memcpy(out, kMagic, 8);
+  put(out, 8, kVersion);
+  put(out, 12, n_syms);
+}
+
+inline bool valid_header(const char* in) {
+  return std::memcmp(in, kMagic, 8) == 0 && get<std::uint32_t>(in, 8) == kVersion;
+}
+
+} // namespace journal
+
+// 顺序写；std::ofstream 自带缓冲
+class JournalWriter {
+public:
+  JournalWriter(const std::string& path, std::size_t n_syms)
+      : ofs_(path, std::ios::binary | std::ios::trunc) {
+    char h[journal::kHeaderBytes];
+    journal::encode_header(static_cast<std::uint32_t>(n_syms), h);
+    ofs_.write(h, static_cast<std::streamsize>(journal::kHeaderBytes));
+  }
+
+  JournalWriter(const JournalWriter&) = delete;
+  JournalWriter& operator=(const JournalWriter&) = delete;
+
+  bool good() const { return ofs_.good(); }
+  std::size_t batches_written() const { return batches_; }
+
+  void write(const JournalBatch& b) {
+    using namespace journal;
+    buf_.resize(kBatchBytes + kRecordBytes * (b.cancels.size() + b.submits.size() + 2 * b.fills.size() + b.updates.size()));
+    char* p = buf_.data();
+    encode_batch(b, p);
+    p += kBatchBytes;
+    for (auto const& c : b.cancels) { encode(c, p); p += kRecordBytes; }
+    for (auto const& s : b.submits) { encode(s, p); p += kRecordBytes; }
+    for (auto const& f : b.fills) { encode(f, p); p += 2 * kRecordBytes; }
+    for (auto const& u : b.updates) { encode(u, p); p += kRecordBytes; }
+    ofs_.write(buf_.data(), static_cast<std::streamsize>(buf_.size()));
+    ++batches_;
+  }
+
+  void close() {
+    if (ofs_.is_open()) ofs_.close();
+  }
+
+private:
+  std::ofstream ofs_;
+  std::string buf_;
+  std::size_t batches_{0};
+};
+
+// 顺序读 + 与重放结果对账：
+// - commands(batch)：该 batch 记录的命令（没有记录 => 空），batch 必须递增
+// - verify(actual)：比较 fills / updates / fill_digest，记下第一个分叉的 batch
+class JournalReader {
+public:
+  explicit JournalReader(const std::string& path) : ifs_(path, std::ios::binary) {
+    char h[journal::kHeaderBytes];
+    if (!ifs_.read(h, static_cast<std::streamsize>(journal::kHeaderBytes)) || !journal::valid_header(h)) {
+      ok_ = false;
+      return;
+    }
+    n_syms_ = journal::get<std::uint32_t>(h, 12);
+    advance();
+  }
+
+  JournalReader(const JournalReader&) = delete;
+  JournalReader& operator=(const JournalReader&) = delete;
+
+  bool ok() const { return ok_; }
+  std::size_t n_syms() const { return n_syms_; }
+
+  // 分叉后是否让 engine 提前结束（二分定位时不必跑完整个区间）
+  bool stop_on_divergence{true};
+
+  const JournalBatch* commands(std::uint64_t batch) {
+    while (has_next_ && next_.batch < batch) {
+      // 记录里有、重放时没走到过的 batch（例如 batch 序号对不上）
+      diverge(next_.batch, "recorded batch skipped");
+      advance();
+    }
+    return (has_next_ && next_.batch == batch) ? &next_ : nullptr;
+  }
+
+  // 本 batch 的实际结果；在 commands(batch) 之后调用
+  void verify(const JournalBatch& actual) {
+    const JournalBatch* exp = (has_next_ && next_.batch == actual.batch) ? &next_ : nullptr;
+    if (!exp) {
+      if (!actual.fills.empty() || !actual.updates.empty()) diverge(actual.batch, "unexpected fills / updates");
+      return;
+    }
+    if (exp->ts != actual.ts) diverge(actual.batch, "batch ts differs");
+    else if (!same_fills(exp->fills, actual.fills)) diverge(actual.batch, "fills differ");
+    else if (!same_updates(exp->updates, actual.updates)) diverge(actual.batch, "order updates differ");
+    else if (exp->fill_digest != actual.fill_digest) diverge(actual.batch, "fill digest differs");
+    ++verified_;
+    advance();
+  }
+
+  // 重放结束时：journal 里还有剩余 batch 也算分叉
+  void finish() {
+    if (has_next_) diverge(next_.batch, "recorded batches left after replay");
+  }
+
+  bool diverged() const { return first_divergence_ != 0; }
+  std::uint64_t first_divergence() const { return first_divergence_; }
+  const std::string& reason() const { return reason_; }
+  std::size_t batches_verified() const { return verified_; }
+
+private:
+  void advance() {
+    using namespace journal;
+    has_next_ = false;
+    char hb[kBatchBytes];
+    if (!ifs_.read(hb, static_cast<std::streamsize>(kBatchBytes))) return;
+    next_.clear();
+    next_.batch = get<std::uint64_t>(hb, 0);
+    next_.ts = get<std::int64_t>(hb, 8);
+    next_.fill_digest = get<std::uint64_t>(hb, 16);
+    const auto nc = get<std::uint32_t>(hb, 24);
+    const auto ns = get<std::uint32_t>(hb, 28);
+    const auto nf = get<std::uint32_t>(hb, 32);
+    const auto nu = get<std::uint32_t>(hb, 36);
+    buf_.resize(kRecordBytes * (std::size_t{nc} + ns + 2 * std::size_t{nf} + nu));
+    if (!ifs_.read(buf_.data(), static_cast<std::streamsize>(buf_.size()))) {
+      ok_ = false; // 截断的文件
+      return;
+    }
+    const char* p = buf_.data();
+    for (std::uint32_t k = 0; k < nc; ++k, p += kRecordBytes) next_.cancels.push_back(decode_cancel(p));
+    for (std::uint32_t k = 0; k < ns; ++k, p += kRecordBytes) next_.submits.push_back(decode_submit(p));
+    for (std::uint32_t k = 0; k < nf; ++k, p += 2 * kRecordBytes) next_.fills.push_back(decode_fill(p));
+    for (std::uint32_t k = 0; k < nu; ++k, p += kRecordBytes) next_.updates.push_back(decode_update(p));
+    has_next_ = true;
+  }
+
+  static bool same_fills(const std::vector<JournalBatch::SymFill>& a, const std::vector<JournalBatch::SymFill>& b) {
+    if (a.size() != b.size()) return false;
+    for (std::size_t k = 0; k < a.size(); ++k) {
+      const auto& x = a[k];
+      const auto& y = b[k];
+      if (x.sym_idx != y.sym_idx || x.f.ts_ns != y.f.ts_ns || x.f.order_id != y.f.order_id ||
+          x.f.side != y.f.side || x.f.price != y.f.price || x.f.qty != y.f.qty) return false;
+    }
+    return true;
+  }
+
+  static bool same_updates(const std::vector<JournalBatch::SymUpdate>& a, const std::vector<JournalBatch::SymUpdate>& b) {
+    if (a.size() != b.size()) return false;
+    for (std::size_t k = 0; k < a.size(); ++k) {
+      const auto& x = a[k];
+      const auto& y = b[k];
+      if (x.sym_idx != y.sym_idx || x.up.ts_ns != y.up.ts_ns || x.up.order_id != y.up.order_id ||
+          x.up.status != y.up.status) return false;
+    }
+    return true;
+  }
+
+  void diverge(std::uint64_t batch, const char* why) {
+    if (first_divergence_ != 0) return;
+    first_divergence_ = batch;
+    reason_ = why;
+  }
+
+  std::ifstream ifs_;
+  bool ok_{true};
+  std::size_t n_syms_{0};
+  std::string buf_;
+  JournalBatch next_;
+  bool has_next_{false};
+  std::size_t verified_{0};
+  std::uint64_t first_divergence_{0};
+  std::string reason_;
+};
+
+} // namespace bt3
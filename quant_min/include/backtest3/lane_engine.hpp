@@ -0,0 +1,248 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include "backtest3/engine.hpp"          // EngineConfig / RunStats / FillDigest
+#include "backtest3/symbol_context.hpp"  // top_view
+#include "backtest3/portfolio.hpp"
+#include "backtest3/portfolio_risk.hpp"
+#include "backtest3/strategy_portfolio.hpp"
+
+namespace bt3 {
+
+// 多配置（lane）回测引擎：K 组参数共用一次归并 + 一次 book 构建，OMS / exec / 组合 / 风控按 lane 各自一份
+// - 单线程（并行度来自 sweep 把不同的 lane 组放到不同线程）；EngineConfig 里只用
+//   enable_portfolio_risk / quiet
+// - 每个 lane 的 fills 顺序与单独跑 MultiSymbolEngine 一致（fill_digest 可对账）：
+//   Phase A 按 sym 升序、逐事件撮合；决策后先逐笔过风控，再按 sym 升序先 cancel 后 submit
+// - StrategyT：on_order_updated(lane, sym, up) / on_batch(snapshot, portfolios, decisions)，
+//   例如 MeanReversionLanesStrategy
+class LaneEngine {
+public:
+  LaneEngine(std::size_t n_symbols,
+             EngineConfig cfg,
+             const std::vector<bt::ExecConfig>& lane_exec,
+             const PortfolioRiskConfig& prisk_cfg = {})
+      : n_(n_symbols),
+        k_(lane_exec.size()),
+        cfg_(cfg),
+        books_(n_),
+        snap_(n_),
+        per_sym_bucket_(n_),
+        lane_syms_(k_ * n_),
+        pfs_(k_, Portfolio(n_)) {
+    prisk_.reserve(k_);
+    for (std::size_t k = 0; k < k_; ++k) {
+      prisk_.emplace_back(prisk_cfg, n_);
+      for (std::size_t i = 0; i < n_; ++i) lane_syms_[k * n_ + i].exec = bt::ExecutionSim(lane_exec[k]);
+    }
+  }
+
+  std::size_t lanes() const { return k_; }
+  const Portfolio& portfolio(std::size_t lane) const { return pfs_[lane]; }
+
+  template <class SchedulerT, class StrategyT>
+  std::vector<RunStats> run(SchedulerT& sched, StrategyT& strat) {
+    const auto wall0 = std::chrono::steady_clock::now();
+    std::vector<RunStats> st(k_);
+    std::vector<double> peak(k_, 0.0);
+    std::vector<FillDigest> digest(k_);
+    for (auto& d : digest) d.reset(n_);
+
+    auto sample_equity = [&]() {
+      for (std::size_t k = 0; k < k_; ++k) {
+        const double eq = pfs_[k].equity();
+        peak[k] = std::max(peak[k], eq);
+        st[k].max_drawdown = std::max(st[k].max_drawdown, peak[k] - eq);
+        st[k].final_equity = eq;
+      }
+    };
+
+    auto apply_outputs = [&](std::size_t k, std::size_t i) {
+      auto& ls = lane_syms_[k * n_ + i];
+      for (auto const& fe : ls.fills) {
+        pfs_[k].apply_fill(i, fe);
+        if (cfg_.enable_portfolio_risk) prisk_[k].on_fill(i, fe);
+        digest[k].add(i, fe);
+        ++st[k].fills;
+      }
+      for (auto const& up : ls.updates) strat.on_order_updated(k, i, up);
+    };
+
+    std::size_t batches = 0;
+    std::size_t events = 0;
+    for (;;) {
+      for (auto i : touched_) per_sym_bucket_[i].clear();
+      touched_.clear();
+      const auto n_ev = sched.next_batch_into([this](std::size_t sym_idx, const q::market::MarketEvent& e) {
+        auto& bucket = per_sym_bucket_[sym_idx];
+        if (bucket.empty()) touched_.push_back(sym_idx);
+        bucket.push_back(e);
+      });
+      if (n_ev == 0) break;
+      const auto ts = sched.batch_ts();
+      std::sort(touched_.begin(), touched_.end());
+      ++batches;
+      events += n_ev;
+
+      // ====================== Phase A: Market ======================
+      // book 每个 symbol 只推一次，每个有效事件的视图依次喂给所有 lane 的 exec
+      snap_.clear_dirty();
+      for (auto i : touched_) {
+        auto& b = books_[i];
+        for (std::size_t k = 0; k < k_; ++k) {
+          auto& ls = lane_syms_[k * n_ + i];
+          ls.fills.clear();
+          ls.updates.clear();
+        }
+        auto mv = snap_.view(i);
+        for (auto const& e : per_sym_bucket_[i]) {
+          b.builder.on_event(e);
+          if (!b.builder.book_valid()) continue;
+          mv = top_view(b.book, ts);
+          for (std::size_t k = 0; k < k_; ++k) {
+            auto& ls = lane_syms_[k * n_ + i];
+            if (ls.live) match_on_view(ls, mv);
+          }
+        }
+        snap_.set(i, mv);
+      }
+      {
+        const std::int64_t* mid = snap_.mid();
+        snap_.for_each_dirty([this, mid](std::size_t i) {
+          for (std::size_t k = 0; k < k_; ++k) {
+            pfs_[k].on_mid(i, mid[i]);
+            if (cfg_.enable_portfolio_risk) prisk_[k].on_mid(i, mid[i]);
+          }
+        });
+      }
+      for (auto i : touched_) {
+        for (std::size_t k = 0; k < k_; ++k) apply_outputs(k, i);
+      }
+      sample_equity();
+      if (cfg_.enable_portfolio_risk) {
+        for (std::size_t k = 0; k < k_; ++k) prisk_[k].on_equity(pfs_[k].equity());
+      }
+
+      // ====================== Strategy Decision（所有 lane 一次）======================
+      strat.on_batch(snap_, pfs_, decisions_);
+
+      // ====================== Phase B: Orders（逐 lane）======================
+      for (std::size_t k = 0; k < k_; ++k) {
+        auto& dec = decisions_[k];
+        // 先按决策顺序逐笔过风控（与 MultiSymbolEngine 一致：全部检查完才进 Phase B）
+        accepted_.clear();
+        for (auto const& s : dec.submits) {
+          if (s.sym_idx >= n_) continue;
+          if (cfg_.enable_portfolio_risk && !prisk_[k].pre_trade_check(s).ok) {
+            ++st[k].prisk_rejects;
+            continue;
+          }
+          accepted_.push_back(&s);
+        }
+        // 按 sym 升序处理；同一 sym 内保持决策顺序
+        std::stable_sort(dec.cancels.begin(), dec.cancels.end(),
+                         [](const CancelIntent& a, const CancelIntent& b) { return a.sym_idx < b.sym_idx; });
+        std::stable_sort(accepted_.begin(), accepted_.end(),
+                         [](const OrderIntent* a, const OrderIntent* b) { return a->sym_idx < b->sym_idx; });
+
+        std::size_t ci = 0;
+        std::size_t si = 0;
+        while (ci < dec.cancels.size() || si < accepted_.size()) {
+          const auto i = std::min(ci < dec.cancels.size() ? dec.cancels[ci].sym_idx : n_,
+                                  si < accepted_.size() ? accepted_[si]->sym_idx : n_);
+          if (i >= n_) {
+            ++ci; // 越界的 cancel，丢弃
+            continue;
+          }
+          auto& ls = lane_syms_[k * n_ + i];
+          const auto mv = snap_.view(i);
+          ls.fills.clear();
+          ls.updates.clear();
+          for (; ci < dec.cancels.size() && dec.cancels[ci].sym_idx == i; ++ci) {
+            ls.updates.push_back(ls.exec.cancel(ls.oms, mv, dec.cancels[ci].order_id));
+          }
+          for (; si < accepted_.size() && accepted_[si]->sym_idx == i; ++si) {
+            auto res = ls.exec.submit(ls.oms, mv, accepted_[si]->req);
+            ls.updates.push_back(std::move(res.ack));
+            if (res.fill) ls.fills.push_back(*res.fill);
+            for (auto& u : ls.exec.drain_updates()) ls.updates.push_back(std::move(u));
+          }
+          refresh_live(ls);
+          apply_outputs(k, i);
+        }
+      }
+
+      // 与 MultiSymbolEngine 一样在两个 barrier 之后各采一次回撤
+      sample_equity();
+    }
+
+    const double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall0).count();
+    for (std::size_t k = 0; k < k_; ++k) st[k].fill_digest = digest[k].value();
+    for (auto& s : st) {
+      s.batches = batches;
+      s.events = events;
+      s.wall_s = wall_s;
+    }
+    if (!cfg_.quiet) {
+      std::cout << "DONE lanes=" << k_
+                << " batches=" << batches
+                << " events=" << events
+                << " wall_s=" << wall_s
+                << "\n";
+    }
+    return st;
+  }
+
+private:
+  struct BookState {
+    q::book::FlatL2Book book{};
+    q::book::BookBuilder<q::book::FlatL2Book> builder{&book};
+  };
+
+  // 一个 lane 在一个 symbol 上的交易状态（对应 SymbolContext 去掉 book 的部分）
+  struct LaneSym {
+    bt::Oms oms{};
+    bt::ExecutionSim exec{};
+    std::vector<bt::FillEvent> fills;
+    std::vector<bt::OrderUpdate> updates;
+    // 有 active 订单（Working / PartiallyFilled / CancelRequested）；没有时 on_market 是空操作，直接跳过
+    // 订单只会在 Phase B 变成 active，只会在产生 fill / update 时离开 active，在这两处重算
+    bool live{false};
+  };
+
+  static void refresh_live(LaneSym& ls) {
+    ls.live = false;
+    ls.oms.for_each_active([&ls](const bt::Order&) { ls.live = true; });
+  }
+
+  static void match_on_view(LaneSym& ls, const MarketView& mv) {
+    const auto n_fills = ls.fills.size();
+    const auto n_updates = ls.updates.size();
+    for (auto& f : ls.exec.on_market(ls.oms, mv)) ls.fills.push_back(f);
+    for (auto& u : ls.exec.drain_updates()) ls.updates.push_back(std::move(u));
+    if (ls.fills.size() != n_fills || ls.updates.size() != n_updates) refresh_live(ls);
+  }
+
+  std::size_t n_;
+  std::size_t k_;
+  EngineConfig cfg_;
+
+  std::vector<BookState> books_;    // 每个 symbol 一份，所有 lane 共享
+  MarketSnapshot snap_;             // 每个 symbol 最近一个有效视图
+  std::vector<std::vector<q::market::MarketEvent>> per_sym_bucket_;
+  std::vector<std::size_t> touched_;
+
+  std::vector<LaneSym> lane_syms_;  // [lane][sym]
+  std::vector<Portfolio> pfs_;      // [lane]
+  std::vector<PortfolioRisk> prisk_;
+  std::vector<PortfolioDecision> decisions_;
+  std::vector<const OrderIntent*> accepted_;
+};
+
+} // namespace bt3
@@ -0,0 +1,102 @@
+#pragma once
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "backtest/market_view.hpp"
+
+namespace bt3 {
+
+// 所有 symbol 最新视图的 SoA 快照：ts / bid / ask / mid 各一列 + 本 batch 的变化位图
+// - 写：Phase A 里处理该 symbol 的线程直接写自己那一格（同一 symbol 同一时刻只有一个写者），
+//   主线程不再在 barrier 后逐个拷贝视图
+// - dirty：本 batch 内 bid / ask / mid 有变化的 symbol；一个字管 64 个 symbol，不同 worker 可能落在同一个字，
+//   用 relaxed fetch_or，可见性由 phase barrier 保证
+// - 读：barrier 之后主线程（策略 / 风控 / equity）按列扫描，或用 for_each_dirty 只看变化的 symbol
+// - 未收到过有效视图的 symbol 各列为 0（与 MarketView{} 一致）
+class MarketSnapshot {
+public:
+  explicit MarketSnapshot(std::size_t n = 0) { resize(n); }
+
+  void resize(std::size_t n) {
+    n_ = n;
+    ts_.assign(n, 0);
+    bid_.assign(n, 0);
+    ask_.assign(n, 0);
+    mid_.assign(n, 0);
+    n_words_ = (n + 63) / 64;
+    dirty_ = std::make_unique<std::atomic<std::uint64_t>[]>(n_words_);
+    for (std::size_t w = 0; w < n_words_; ++w) dirty_[w].store(0, std::memory_order_relaxed);
+  }
+
+  std::size_t size() const { return n_; }
+
+  // 返回 bid / ask / mid 是否有变化
+  bool set(std::size_t i, const MarketView& mv) {
+    const bool changed = bid_[i] != mv.best_bid_px || ask_[i] != mv.best_ask_px || mid_[i] != mv.mid_px;
+    ts_[i] = mv.ts_ns;
+    bid_[i] = mv.best_bid_px;
+    ask_[i] = mv.best_ask_px;
+    mid_[i] = mv.mid_px;
+    if (changed) mark_dirty(i);
+    return changed;
+  }
+
+  MarketView view(std::size_t i) const { return MarketView{ts_[i], bid_[i], ask_[i], mid_[i]}; }
+
+  // 列访问（SIMD 友好）
+  const std::int64_t* ts() const { return ts_.data(); }
+  const std::int64_t* bid() const { return bid_.data(); }
+  const std::int64_t* ask() const { return ask_.data(); }
+  const std::int64_t* mid() const { return mid_.data(); }
+
+  bool dirty(std::size_t i) const {
+    return (dirty_[i >> 6].load(std::memory_order_relaxed) >> (i & 63)) & 1u;
+  }
+
+  // 按 sym 升序访问本 batch 变化的 symbol
+  template <class F>
+  void for_each_dirty(F&& f) const {
+    for (std::size_t w = 0; w < n_words_; ++w) {
+      auto bits = dirty_[w].load(std::memory_order_relaxed);
+      while (bits) {
+        f(w * 64 + static_cast<std::size_t>(std::countr_zero(bits)));
+        bits &= bits - 1;
+      }
+    }
+  }
+
+  std::size_t dirty_count() const {
+    std::size_t c = 0;
+    for (std::size_t w = 0; w < n_words_; ++w) c += static_cast<std::size_t>(std::popcount(dirty_[w].load(std::memory_order_relaxed)));
+    return c;
+  }
+
+  // batch 开始前（主线程，worker 都已 join）
+  void clear_dirty() {
+    for (std::size_t w = 0; w < n_words_; ++w) {
+      if (dirty_[w].load(std::memory_order_relaxed)) dirty_[w].store(0, std::memory_order_relaxed);
+    }
+  }
+
+private:
+  void mark_dirty(std::size_t i) {
+    const auto bit = std::uint64_t{1} << (i & 63);
+    auto& w = dirty_[i >> 6];
+    if (!(w.load(std::memory_order_relaxed) & bit)) w.fetch_or(bit, std::memory_order_relaxed);
+  }
+
+  std::size_t n_{0};
+  std::vector<std::int64_t> ts_;
+  std::vector<std::int64_t> bid_;
+  std::vector<std::int64_t> ask_;
+  std::vector<std::int64_t> mid_;
+
+  std::size_t n_words_{0};
+  std::unique_ptr<std::atomic<std::uint64_t>[]> dirty_;
+};
+
+} // namespace bt3
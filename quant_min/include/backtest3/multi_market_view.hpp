@@ -1,15 +1,18 @@
 #pragma once
 #include <cstddef>
+#include <cstdint>
 #include <vector>
 
+#include "backtest/market_view.hpp"
+#include "backtest3/market_snapshot.hpp"
 #include "backtest3/types.hpp"
 
 namespace bt3 {
 
 struct MultiMarketView {
   std::int64_t ts_ns{};
-  const std::vector<MarketView>* mvs{nullptr}; // snapshot after barrier
-  const MarketView& mv(std::size_t idx) const { return (*mvs)[idx]; }
+  const MarketSnapshot* snap{nullptr}; // snapshot after barrier
+  MarketView mv(std::size_t idx) const { return snap->view(idx); }
 };
 
 } // namespace bt3
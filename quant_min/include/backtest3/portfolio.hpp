@@ -4,53 +4,181 @@
 #include <cmath>
 
 #include "backtest3/types.hpp"
+#include "backtest3/market_snapshot.hpp"
+#include "backtest/market_view.hpp"
 #include "backtest/orders.hpp"
+#include "common/serialize.hpp"
 
 namespace bt3 {
 
 struct PositionState {
   std::int64_t pos{0};
   std::int64_t cash{0}; // 用“价格单位 * qty”的整数现金（和 mid 一致）
+  std::int64_t mid{0};  // 最近一次 on_mid 的 mark
+  std::int64_t cost{0}; // 持仓成本（带符号，均价法）：空仓为 0，多头 > 0，空头 < 0
 };
 
+// 组合层汇总量的增量（int64，加法可交换 => 各 worker 的部分和按任意顺序归约结果都一样）
+struct PortfolioDelta {
+  std::int64_t equity{0};
+  std::int64_t realized{0};
+};
+
+// 组合层汇总（分片运行时 coordinator 在分片之间交换的量）：equity 来自 Portfolio，敞口来自 PortfolioRisk
+struct PortfolioAggregates {
+  std::int64_t equity{0};
+  std::int64_t gross{0};                 // sum(|pos|*mid)
+  std::int64_t net{0};                   // sum(pos*mid)
+  std::vector<std::int64_t> group_gross; // 按全局组号
+  bool killed{false};
+};
+
+// 成本 / PnL 的中间量：cost * new_pos 这类积在结果与名义金额都在 int64 内时也可能溢出，按 128 位算
+namespace pnl {
+__extension__ using i128 = __int128;
+} // namespace pnl
+
+// 组合账本：equity / realized / unrealized 由 apply_fill 与 on_mid 增量维护，读取 O(1)
+// - equity = sum(cash + pos * mid)；全是 int64，与全量重算逐位一致
+// - 每个 symbol：realized = cash + cost（已平仓部分），unrealized = pos * mid - cost（按均价计的浮盈）
+//   两者之和恒等于该 symbol 的 pnl；平仓按比例扣 cost（整数截断，误差留在 realized，不破坏恒等式）
+// - 并行：*_local 只写该 symbol 自己的状态、把汇总增量记到调用方的 PortfolioDelta，
+//   可以在处理该 symbol 的 worker 里调用；barrier 后主线程 apply_delta 归约
 class Portfolio {
 public:
   explicit Portfolio(std::size_t n_syms = 0) : st_(n_syms) {}
 
-  void resize(std::size_t n_syms) { st_.assign(n_syms, PositionState{}); }
+  void resize(std::size_t n_syms) {
+    st_.assign(n_syms, PositionState{});
+    equity_ = 0;
+    realized_ = 0;
+  }
 
   std::int64_t pos(std::size_t idx) const { return st_[idx].pos; }
   std::int64_t cash(std::size_t idx) const { return st_[idx].cash; }
+  std::int64_t mid(std::size_t idx) const { return st_[idx].mid; }
 
-  void set_pos(std::size_t idx, std::int64_t p) { st_[idx].pos = p; }
-  void set_cash(std::size_t idx, std::int64_t c) { st_[idx].cash = c; }
+  // 外部直接改持仓 / 现金（初始化用）：新持仓按当前 mid 记成本
+  void set_pos(std::size_t idx, std::int64_t p) {
+    auto& s = st_[idx];
+    equity_ += (p - s.pos) * s.mid;
+    realized_ -= s.cost;
+    s.pos = p;
+    s.cost = p * s.mid;
+    realized_ += s.cost;
+  }
+  void set_cash(std::size_t idx, std::int64_t c) {
+    auto& s = st_[idx];
+    equity_ += c - s.cash;
+    realized_ += c - s.cash;
+    s.cash = c;
+  }
 
   void apply_fill(std::size_t idx, const bt::FillEvent& f) {
+    PortfolioDelta d;
+    apply_fill_local(idx, f, d);
+    apply_delta(d);
+  }
+
+  void on_mid(std::size_t idx, std::int64_t mid) {
+    PortfolioDelta d;
+    on_mid_local(idx, mid, d);
+    apply_delta(d);
+  }
+
+  void apply_fill_local(std::size_t idx, const bt::FillEvent& f, PortfolioDelta& d) {
     // 买入：pos+qty，cash -= px*qty
     // 卖出：pos-qty，cash += px*qty
-    const std::int64_t notional = f.price * f.qty;
-    if (f.side == bt::Side::Buy) {
-      st_[idx].pos += f.qty;
-      st_[idx].cash -= notional;
+    auto& s = st_[idx];
+    const std::int64_t dq = (f.side == bt::Side::Buy) ? f.qty : -f.qty;
+    const std::int64_t d_cash = -f.price * dq;
+    const std::int64_t old_cost = s.cost;
+
+    const std::int64_t new_pos = s.pos + dq;
+    if (s.pos == 0 || (s.pos > 0) == (dq > 0)) {
+      s.cost += f.price * dq; // 开仓 / 加仓
+    } else if ((s.pos > 0) == (new_pos > 0) && new_pos != 0) {
+      // 部分平仓：剩余成本按剩余持仓比例保留；|new_pos| < |pos| => 结果不超过原 cost，只有中间积要 128 位
+      s.cost = static_cast<std::int64_t>(static_cast<pnl::i128>(s.cost) * new_pos / s.pos);
     } else {
-      st_[idx].pos -= f.qty;
-      st_[idx].cash += notional;
+      s.cost = f.price * new_pos; // 平仓（含反手：剩余部分按成交价开新仓）
     }
+
+    s.pos = new_pos;
+    s.cash += d_cash;
+    d.equity += d_cash + dq * s.mid;
+    d.realized += d_cash + (s.cost - old_cost);
   }
 
-  double equity(const std::vector<MarketView>& mvs) const {
+  // mark 变化：只有该 symbol 的浮盈变
+  void on_mid_local(std::size_t idx, std::int64_t mid, PortfolioDelta& d) {
+    auto& s = st_[idx];
+    d.equity += s.pos * (mid - s.mid);
+    s.mid = mid;
+  }
+
+  void apply_delta(PortfolioDelta& d) {
+    equity_ += d.equity;
+    realized_ += d.realized;
+    d = PortfolioDelta{};
+  }
+
+  // 以下 O(1)
+  double equity() const { return static_cast<double>(equity_); }
+  std::int64_t equity_int() const { return equity_; }
+  std::int64_t realized_pnl() const { return realized_; }
+  std::int64_t unrealized_pnl() const { return equity_ - realized_; }
+
+  // per-symbol attribution
+  std::int64_t pnl(std::size_t idx) const { return st_[idx].cash + st_[idx].pos * st_[idx].mid; }
+  std::int64_t realized_pnl(std::size_t idx) const { return st_[idx].cash + st_[idx].cost; }
+  std::int64_t unrealized_pnl(std::size_t idx) const { return st_[idx].pos * st_[idx].mid - st_[idx].cost; }
+  std::int64_t cost_basis(std::size_t idx) const { return st_[idx].cost; }
+
+  // 全量重算（按 snapshot 的 mid 列扫描）：long double 累加，大价格 * 大持仓也不会 int64 溢出
+  double equity(const MarketSnapshot& snap) const {
+    const std::int64_t* mid = snap.mid();
     long double eq = 0.0L;
     for (std::size_t i = 0; i < st_.size(); ++i) {
       eq += static_cast<long double>(st_[i].cash);
-      eq += static_cast<long double>(st_[i].pos) * static_cast<long double>(mvs[i].mid_px);
+      eq += static_cast<long double>(st_[i].pos) * static_cast<long double>(mid[i]);
     }
     return static_cast<double>(eq);
   }
 
+  // 与全量重算对账（debug 用，O(n)）：128 位累加，不会在求和途中溢出
+  bool consistent_with(const MarketSnapshot& snap) const {
+    const std::int64_t* mid = snap.mid();
+    pnl::i128 eq = 0;
+    pnl::i128 realized = 0;
+    for (std::size_t i = 0; i < st_.size(); ++i) {
+      if (st_[i].mid != mid[i]) return false;
+      eq += static_cast<pnl::i128>(st_[i].cash) + static_cast<pnl::i128>(st_[i].pos) * mid[i];
+      realized += static_cast<pnl::i128>(st_[i].cash) + st_[i].cost;
+    }
+    return eq == equity_ && realized == realized_;
+  }
+
   std::size_t n_syms() const { return st_.size(); }
 
+  // checkpoint：per-symbol 状态 + 汇总（汇总也存，resume 后不必全量重算）
+  void save(q::ser::Writer& w) const {
+    w.put_vec(st_);
+    w.put(equity_);
+    w.put(realized_);
+  }
+  void load(q::ser::Reader& r) {
+    const auto n = st_.size();
+    r.get_vec(st_);
+    r.get(equity_);
+    r.get(realized_);
+    if (st_.size() != n) r.fail();
+  }
+
 private:
   std::vector<PositionState> st_;
+  std::int64_t equity_{0};   // sum(cash + pos * mid)
+  std::int64_t realized_{0}; // sum(cash + cost)
 };
 
 } // namespace bt3
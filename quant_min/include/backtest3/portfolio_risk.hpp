@@ -1,10 +1,16 @@
 #pragma once
+#include <algorithm>
 #include <cstdint>
 #include <cmath>
+#include <cstdlib>
+#include <limits>
 #include <string>
+#include <utility>
+#include <vector>
 
-#include "backtest3/orders.hpp"
+#include "backtest/risk_checks.hpp"
 #include "backtest3/portfolio.hpp"
+#include "backtest3/strategy_portfolio.hpp"  // OrderIntent
 #include "backtest3/types.hpp"
 
 namespace bt3 {
@@ -17,18 +23,149 @@ struct PortfolioRiskConfig {
   bool enable_kill_switch{true};
   std::int64_t max_consecutive_rejects{50};
 
+  // 分组（行业/板块）敞口：sym_group[i] = 组号；max_gross_per_group[g] <= 0 表示该组不限
+  // 组号 >= max_gross_per_group.size() 的 symbol 都不限，合并到同一个槽统计（组号可以是任意 uint32）
+  // 两者都为空则不做分组检查
+  std::vector<std::uint32_t> sym_group;
+  std::vector<std::int64_t> max_gross_per_group;
+
   // 回撤熔断（可选）
   bool enable_drawdown_kill{false};
   double max_drawdown{0.2}; // 20%
 };
 
-class PortfolioRisk {
+// 名义金额算术：|pos| * mid 及其求和可能超出 int64
+// - 检查里的临界比较用 128 位精确算
+// - 增量汇总仍是 int64（checkpoint / 分片交换的格式不变），每步带溢出检查；溢出后置位，PortfolioRisk 之后一律拒单（fail closed）
+namespace notional {
+
+__extension__ using i128 = __int128;
+
+inline std::int64_t mul(std::int64_t a, std::int64_t b, bool& overflow) {
+  std::int64_t r = 0;
+  if (__builtin_mul_overflow(a, b, &r)) overflow = true;
+  return r;
+}
+
+inline void add(std::int64_t& acc, std::int64_t v, bool& overflow) {
+  if (__builtin_add_overflow(acc, v, &acc)) overflow = true;
+}
+
+inline void sub(std::int64_t& acc, std::int64_t v, bool& overflow) {
+  if (__builtin_sub_overflow(acc, v, &acc)) overflow = true;
+}
+
+} // namespace notional
+
+// 敞口汇总量的增量（gross / net / 分组 gross），int64 部分和，归约顺序无关
+struct ExposureDelta {
+  std::int64_t gross{0};
+  std::int64_t net{0};
+  std::vector<std::int64_t> group; // 长度 = 组槽数（make_delta() 给出）；本轮碰过的组记在 groups_touched
+  std::vector<std::uint32_t> groups_touched;
+  bool overflow{false};
+};
+
+// pre_trade_check 的入参
+struct PortfolioCheckCtx {
+  std::size_t sym_idx;
+  const bt::OrderRequest& req;
+};
+
+namespace checks {
+
+struct HasMid {
+  static constexpr const char* name = "has_mid";
+  template <class Owner>
+  static bt::RejectCode check(const Owner& o, const PortfolioCheckCtx& c) {
+    return o.mid(c.sym_idx) <= 0 ? bt::RejectCode::NoMid : bt::RejectCode::None;
+  }
+};
+
+template <class Owner>
+std::int64_t next_pos(const Owner& o, const PortfolioCheckCtx& c) {
+  return o.pos(c.sym_idx) + ((c.req.side == bt::Side::Buy) ? c.req.qty : -c.req.qty);
+}
+
+// per-symbol position limit (worst-case)
+struct PositionLimitSym {
+  static constexpr const char* name = "pos_limit_sym";
+  template <class Owner>
+  static bt::RejectCode check(const Owner& o, const PortfolioCheckCtx& c) {
+    return std::llabs(next_pos(o, c)) > o.cfg().max_abs_position_per_sym
+               ? bt::RejectCode::PositionLimitSym : bt::RejectCode::None;
+  }
+};
+
+// 把本 symbol 的 |pos|*mid 换成下单后的值（128 位，不会溢出）
+template <class Owner>
+notional::i128 replace_sym_gross(const Owner& o, const PortfolioCheckCtx& c, std::int64_t agg) {
+  using notional::i128;
+  const auto i = c.sym_idx;
+  const i128 mid = o.mid(i);
+  return static_cast<i128>(agg) - static_cast<i128>(std::llabs(o.pos(i))) * mid
+         + static_cast<i128>(std::llabs(next_pos(o, c))) * mid;
+}
+
+// gross notional after trade (worst-case)：增量维护的 gross 只替换本 symbol 一项，O(1)
+struct GrossNotional {
+  static constexpr const char* name = "gross_notional";
+  template <class Owner>
+  static bt::RejectCode check(const Owner& o, const PortfolioCheckCtx& c) {
+    const auto gross = replace_sym_gross(o, c, o.gross_notional()) + o.remote_gross();
+    return gross > o.cfg().max_gross_notional ? bt::RejectCode::GrossNotional : bt::RejectCode::None;
+  }
+};
+
+// 分组 gross notional，同样 O(1)
+struct GroupNotional {
+  static constexpr const char* name = "group_notional";
+  template <class Owner>
+  static bt::RejectCode check(const Owner& o, const PortfolioCheckCtx& c) {
+    const auto i = c.sym_idx;
+    const std::int64_t limit = o.group_limit_of(i);
+    if (limit <= 0) return bt::RejectCode::None;
+    const auto g = o.group_of(i);
+    const auto gross = replace_sym_gross(o, c, o.group_gross(g)) + o.remote_group_gross(g);
+    return gross > limit ? bt::RejectCode::GroupNotional : bt::RejectCode::None;
+  }
+};
+
+} // namespace checks
+
+using DefaultPortfolioChecks = bt::CheckPipeline<bt::checks::QtyPositive,
+                                                 bt::checks::MaxOrderQty,
+                                                 checks::HasMid,
+                                                 checks::PositionLimitSym,
+                                                 checks::GrossNotional,
+                                                 checks::GroupNotional>;
+
+template <class Checks>
+class BasicPortfolioRisk {
 public:
-  explicit PortfolioRisk(PortfolioRiskConfig cfg = {}) : cfg_(cfg) {}
+  explicit BasicPortfolioRisk(PortfolioRiskConfig cfg = {}, std::size_t n_syms = 0) : cfg_(std::move(cfg)) {
+    resize(n_syms);
+  }
+
+  // 组槽：0..L-1 是有限额配置的组号（L = max_gross_per_group.size()），L 是其余所有组号（不限）
+  // => group_gross_ 的长度只取决于限额表，与组号的取值无关
+  void resize(std::size_t n_syms) {
+    const auto n_limits = cfg_.max_gross_per_group.size();
+    sym_.assign(n_syms, SymExposure{});
+    for (std::size_t i = 0; i < n_syms; ++i) {
+      const std::size_t g = i < cfg_.sym_group.size() ? cfg_.sym_group[i] : 0;
+      sym_[i].group = static_cast<std::uint32_t>(std::min(g, n_limits));
+    }
+    group_gross_.assign(n_limits + 1, 0);
+    gross_ = 0;
+    net_ = 0;
+    overflow_ = false;
+  }
 
   struct Decision {
     bool ok{true};
-    std::string reason;
+    bt::RejectCode code{bt::RejectCode::None};
+    const char* reason{""};
   };
 
   void on_equity(double eq) {
@@ -42,55 +179,220 @@ public:
   }
 
   bool killed() const { return killed_; }
+  const PortfolioRiskConfig& cfg() const { return cfg_; }
+
+  // ---- 增量维护的敞口：由成交与 mid 变化驱动，pre_trade_check 不再扫全组合 ----
+  void on_fill(std::size_t sym_idx, const bt::FillEvent& f) {
+    const auto& e = sym_[sym_idx];
+    set_exposure(sym_idx, e.pos + ((f.side == bt::Side::Buy) ? f.qty : -f.qty), e.mid);
+  }
+
+  void on_mid(std::size_t sym_idx, std::int64_t mid) {
+    const auto& e = sym_[sym_idx];
+    if (e.mid != mid) set_exposure(sym_idx, e.pos, mid);
+  }
+
+  // 并行版本：只写该 symbol 的敞口，汇总增量记到 d（处理该 symbol 的 worker 里调用），barrier 后 apply_delta
+  ExposureDelta make_delta() const {
+    ExposureDelta d;
+    d.group.assign(group_gross_.size(), 0);
+    return d;
+  }
+
+  void on_fill_local(std::size_t sym_idx, const bt::FillEvent& f, ExposureDelta& d) {
+    const auto& e = sym_[sym_idx];
+    set_exposure_local(sym_idx, e.pos + ((f.side == bt::Side::Buy) ? f.qty : -f.qty), e.mid, d);
+  }
+
+  void on_mid_local(std::size_t sym_idx, std::int64_t mid, ExposureDelta& d) {
+    const auto& e = sym_[sym_idx];
+    if (e.mid != mid) set_exposure_local(sym_idx, e.pos, mid, d);
+  }
 
-  Decision pre_trade_check(const Portfolio& pf,
-                           const std::vector<MarketView>& mvs,
-                           std::size_t sym_idx,
-                           const OrderIntent& oi) {
-    if (killed_) return reject("killed");
-    if (oi.qty <= 0) return reject("qty<=0");
-    if (oi.qty > cfg_.max_order_qty) return reject("qty>max_order_qty");
-
-    const auto mid = mvs[sym_idx].mid_px;
-    if (mid <= 0) return reject("no_mid");
-
-    // per-symbol position limit (worst-case)
-    std::int64_t next_pos = pf.pos(sym_idx) + ((oi.side == Side::Buy) ? oi.qty : -oi.qty);
-    if (std::llabs(next_pos) > cfg_.max_abs_position_per_sym) return reject("pos_limit_sym");
-
-    // gross notional after trade (worst-case, simplistic)
-    // compute gross = sum(|pos|*mid) with hypothetical next_pos for this sym
-    long double gross = 0.0L;
-    for (std::size_t i = 0; i < pf.n_syms(); ++i) {
-      std::int64_t p = pf.pos(i);
-      if (i == sym_idx) p = next_pos;
-      gross += static_cast<long double>(std::llabs(p)) * static_cast<long double>(mvs[i].mid_px);
+  void apply_delta(ExposureDelta& d) {
+    bool of = d.overflow;
+    notional::add(gross_, d.gross, of);
+    notional::add(net_, d.net, of);
+    for (auto g : d.groups_touched) {
+      notional::add(group_gross_[g], d.group[g], of);
+      d.group[g] = 0;
     }
-    if (gross > static_cast<long double>(cfg_.max_gross_notional)) return reject("gross_notional");
+    if (of) overflow_ = true;
+    d.gross = 0;
+    d.net = 0;
+    d.groups_touched.clear();
+    d.overflow = false;
+  }
+
+  std::int64_t pos(std::size_t sym_idx) const { return sym_[sym_idx].pos; }
+  std::int64_t mid(std::size_t sym_idx) const { return sym_[sym_idx].mid; }
+  std::int64_t gross_notional() const { return gross_; }
+  std::int64_t net_notional() const { return net_; }
+
+  // 名义金额超出过 int64：汇总不再可信，pre_trade_check 一律拒单
+  bool notional_overflow() const { return overflow_; }
+
+  std::uint32_t group_of(std::size_t sym_idx) const { return sym_[sym_idx].group; }
+  std::int64_t group_gross(std::uint32_t g) const { return group_gross_[g]; }
+  const std::vector<std::int64_t>& group_grosses() const { return group_gross_; }
+  std::int64_t group_limit_of(std::size_t sym_idx) const {
+    const auto g = sym_[sym_idx].group;
+    return g < cfg_.max_gross_per_group.size() ? cfg_.max_gross_per_group[g] : 0;
+  }
+
+  // 分片运行：其余分片的敞口汇总（coordinator 每个全局 ts 下发一次），gross / 分组检查按 本分片 + 其余分片 算；
+  // 任一分片熔断则全体熔断。单进程运行时为 0
+  void set_remote(const PortfolioAggregates& r) {
+    remote_gross_ = r.gross;
+    remote_group_.assign(r.group_gross.begin(), r.group_gross.end());
+    if (r.killed) killed_ = true;
+  }
+  std::int64_t remote_gross() const { return remote_gross_; }
+  std::int64_t remote_group_gross(std::uint32_t g) const { return g < remote_group_.size() ? remote_group_[g] : 0; }
+
+  // 与全量重算对账（debug 用，O(n)）
+  bool consistent_with(const Portfolio& pf, const MarketSnapshot& snap) const {
+    if (overflow_) return true; // 汇总已作废（一律拒单），不再对账
+    const std::int64_t* mid = snap.mid();
+    std::int64_t gross = 0;
+    for (std::size_t i = 0; i < sym_.size(); ++i) {
+      if (sym_[i].pos != pf.pos(i) || sym_[i].mid != mid[i]) return false;
+      gross += std::llabs(pf.pos(i)) * mid[i];
+    }
+    return gross == gross_;
+  }
+
+  Decision pre_trade_check(const OrderIntent& oi) {
+    if (killed_) return reject(bt::RejectCode::Killed);
+    if (overflow_) [[unlikely]] return reject(bt::RejectCode::NotionalOverflow);
+
+    const auto rc = checks_.run(*this, PortfolioCheckCtx{oi.sym_idx, oi.req});
+    if (rc != bt::RejectCode::None) [[unlikely]] return reject(rc);
 
     // pass
     consecutive_rejects_ = 0;
     last_reason_.clear();
-    return {true, ""};
+    return {};
+  }
+
+  // per-check 计数 / 耗时
+  const Checks& checks() const { return checks_; }
+  void set_check_timing(bool on) { checks_.set_timing(on); }
+
+  // checkpoint：kill switch / 回撤峰值 / 敞口（symbol 分组来自 cfg，不存）
+  void save(q::ser::Writer& w) const {
+    w.put(killed_);
+    w.put(consecutive_rejects_);
+    w.put_str(last_reason_);
+    w.put(eq_peak_);
+    w.put(static_cast<std::uint64_t>(sym_.size()));
+    for (auto const& e : sym_) {
+      w.put(e.pos);
+      w.put(e.mid);
+    }
+    w.put_vec(group_gross_);
+    w.put(gross_);
+    w.put(net_);
+    w.put(overflow_);
+  }
+
+  void load(q::ser::Reader& r) {
+    r.get(killed_);
+    r.get(consecutive_rejects_);
+    r.get_str(last_reason_);
+    r.get(eq_peak_);
+    if (r.get<std::uint64_t>() != sym_.size()) {
+      r.fail();
+      return;
+    }
+    for (auto& e : sym_) {
+      r.get(e.pos);
+      r.get(e.mid);
+    }
+    const auto n_groups = group_gross_.size();
+    r.get_vec(group_gross_);
+    r.get(gross_);
+    r.get(net_);
+    r.get(overflow_);
+    if (group_gross_.size() != n_groups) r.fail();
   }
 
 private:
-  Decision reject(const char* r) {
+  struct SymExposure {
+    std::int64_t pos{0};
+    std::int64_t mid{0};
+    std::uint32_t group{0};
+  };
+
+  // 本 symbol 的 gross / net 变化量（旧值在上次写入时已检查过范围）
+  static void exposure_change(const SymExposure& e, std::int64_t new_pos, std::int64_t new_mid,
+                              std::int64_t& d_gross, std::int64_t& d_net, bool& of) {
+    d_gross = notional::mul(std::llabs(new_pos), new_mid, of);
+    notional::sub(d_gross, std::llabs(e.pos) * e.mid, of);
+    d_net = notional::mul(new_pos, new_mid, of);
+    notional::sub(d_net, e.pos * e.mid, of);
+  }
+
+  void set_exposure_local(std::size_t sym_idx, std::int64_t new_pos, std::int64_t new_mid, ExposureDelta& d) {
+    auto& e = sym_[sym_idx];
+    bool of = false;
+    std::int64_t d_gross = 0;
+    std::int64_t d_net = 0;
+    exposure_change(e, new_pos, new_mid, d_gross, d_net, of);
+    notional::add(d.gross, d_gross, of);
+    notional::add(d.net, d_net, of);
+    if (d_gross != 0) {
+      if (d.group[e.group] == 0) d.groups_touched.push_back(e.group);
+      notional::add(d.group[e.group], d_gross, of);
+    }
+    if (of) d.overflow = true;
+    e.pos = new_pos;
+    e.mid = of ? 0 : new_mid; // 溢出的 symbol 按 mid=0 记，保证存下的 |pos|*mid 总在 int64 范围内
+  }
+
+  void set_exposure(std::size_t sym_idx, std::int64_t new_pos, std::int64_t new_mid) {
+    auto& e = sym_[sym_idx];
+    bool of = false;
+    std::int64_t d_gross = 0;
+    std::int64_t d_net = 0;
+    exposure_change(e, new_pos, new_mid, d_gross, d_net, of);
+    notional::add(gross_, d_gross, of);
+    notional::add(net_, d_net, of);
+    notional::add(group_gross_[e.group], d_gross, of);
+    if (of) overflow_ = true;
+    e.pos = new_pos;
+    e.mid = of ? 0 : new_mid;
+  }
+
+  Decision reject(bt::RejectCode rc) {
+    const char* r = bt::reject_reason(rc);
     last_reason_ = r;
     ++consecutive_rejects_;
     if (cfg_.enable_kill_switch && consecutive_rejects_ >= cfg_.max_consecutive_rejects) {
       killed_ = true;
     }
-    return {false, r};
+    return {false, rc, r};
   }
 
 private:
   PortfolioRiskConfig cfg_;
+  Checks checks_;
   bool killed_{false};
   std::int64_t consecutive_rejects_{0};
   std::string last_reason_;
 
   double eq_peak_{-1.0};
+
+  std::vector<SymExposure> sym_;
+  std::vector<std::int64_t> group_gross_;
+  std::int64_t gross_{0}; // sum(|pos|*mid)
+  std::int64_t net_{0};   // sum(pos*mid)
+  bool overflow_{false};  // 见 notional_overflow()
+
+  std::int64_t remote_gross_{0};
+  std::vector<std::int64_t> remote_group_;
 };
 
+using PortfolioRisk = BasicPortfolioRisk<DefaultPortfolioChecks>;
+
 } // namespace bt3
@@ -0,0 +1,250 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+
+#include "common/alloc_counter.hpp"
+#include "common/clock.hpp"
+#include "common/perf_counters.hpp"
+
+namespace bt3 {
+
+// MultiSymbolEngine::run 的 phase（与 trace 点同名）
+enum class Phase : std::uint8_t {
+  Load,
+  MarketA,
+  MergeA,
+  Strategy,
+  RiskCmds,
+  Prebuild,
+  OrdersB,
+  MergeB,
+  Rebalance,
+  Checkpoint,
+  Count
+};
+
+inline constexpr std::size_t kPhaseCount = static_cast<std::size_t>(Phase::Count);
+inline constexpr std::array<const char*, kPhaseCount> kPhaseNames{
+    "load_batch", "phase_a", "merge_a", "strategy", "risk_cmds", "prebuild_join", "phase_b", "merge_b", "rebalance", "checkpoint"};
+
+struct PhaseStats {
+  std::uint64_t calls{0};
+  std::uint64_t wall_ns{0};   // 主线程看到的耗时（分发型 phase 含唤醒 + barrier 等待）
+  std::uint64_t allocs{0};    // 期间全进程 operator new 次数（需 QM_DEFINE_ALLOC_COUNTER）
+  q::PerfSample perf{};       // 主线程的硬件计数器（EngineConfig::perf_counters）
+  // 分发到 worker 的 phase：每次分发各 worker 忙碌时间的 max / mean 累加 => skew = sum_max / sum_mean
+  std::uint64_t dispatches{0};
+  std::uint64_t inline_runs{0}; // 工作量小、主线程直接跑掉的次数
+  double busy_max_ns{0.0};
+  double busy_mean_ns{0.0};
+
+  double skew() const { return busy_mean_ns > 0.0 ? busy_max_ns / busy_mean_ns : 1.0; }
+};
+
+struct WorkerStats {
+  std::uint64_t busy_ns{0}; // 在 phase 里处理 symbol 的时间
+  std::uint64_t wait_ns{0}; // 同一次分发里做完后等最慢 worker 的时间（barrier 等待）
+  std::uint64_t syms{0};
+  std::uint64_t events{0};  // Phase A 处理的 market event 数
+};
+
+// 引擎 profile：EngineConfig::profile 打开时由 run() 填充；关闭时 run() 不取时钟
+class EngineProfile {
+public:
+  struct Mark {
+    std::uint64_t t_ns{0};
+    std::uint64_t allocs{0};
+    q::PerfSample perf{};
+  };
+
+  void reset(std::size_t n_workers, bool perf_counters) {
+    phases_.fill(PhaseStats{});
+    workers_.assign(n_workers, WorkerStats{});
+    batches_ = 0;
+    events_ = 0;
+    wall_ns_ = 0;
+    allocs_ = 0;
+    perf_ok_ = perf_counters && perf_.open();
+  }
+
+  static std::uint64_t now_ns() {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<q::Ns>(q::now().time_since_epoch()).count());
+  }
+
+  Mark mark() const { return Mark{now_ns(), q::alloc::count(), perf_ok_ ? perf_.read() : q::PerfSample{}}; }
+
+  // 主线程 phase 结束：累加 [m0, now)；返回 wall
+  std::uint64_t add(Phase p, const Mark& m0) {
+    const auto m1 = mark();
+    auto& s = phases_[static_cast<std::size_t>(p)];
+    ++s.calls;
+    s.wall_ns += m1.t_ns - m0.t_ns;
+    s.allocs += m1.allocs - m0.allocs;
+    s.perf += m1.perf - m0.perf;
+    return m1.t_ns - m0.t_ns;
+  }
+
+  // 一次分发结束后：busy[k] 是 wids[k] 本次的忙碌时间；wall 为整次分发耗时（count_wait=false 时不计 barrier 等待）
+  template <class BusyOf>
+  void add_dispatch(Phase p, const std::vector<std::size_t>& wids, BusyOf busy_of, std::uint64_t wall_ns, bool count_wait) {
+    auto& s = phases_[static_cast<std::size_t>(p)];
+    if (wids.empty()) return;
+    ++s.dispatches;
+    std::uint64_t mx = 0;
+    std::uint64_t sum = 0;
+    for (auto w : wids) {
+      const std::uint64_t b = busy_of(w);
+      mx = std::max(mx, b);
+      sum += b;
+      workers_[w].busy_ns += b;
+      if (count_wait && wall_ns > b) workers_[w].wait_ns += wall_ns - b;
+    }
+    s.busy_max_ns += static_cast<double>(mx);
+    s.busy_mean_ns += static_cast<double>(sum) / static_cast<double>(wids.size());
+  }
+
+  void add_inline(Phase p) { ++phases_[static_cast<std::size_t>(p)].inline_runs; }
+
+  void finish(std::uint64_t batches, std::uint64_t events, std::uint64_t wall_ns, std::uint64_t allocs) {
+    batches_ = batches;
+    events_ = events;
+    wall_ns_ = wall_ns;
+    allocs_ = allocs;
+  }
+
+  WorkerStats& worker(std::size_t wid) { return workers_[wid]; }
+  const std::vector<WorkerStats>& workers() const { return workers_; }
+  const PhaseStats& phase(Phase p) const { return phases_[static_cast<std::size_t>(p)]; }
+  std::uint64_t batches() const { return batches_; }
+  std::uint64_t wall_ns() const { return wall_ns_; }
+  bool perf_ok() const { return perf_ok_; }
+
+  double allocs_per_batch() const {
+    return batches_ ? static_cast<double>(allocs_) / static_cast<double>(batches_) : 0.0;
+  }
+
+  void print_table(std::ostream& os) const {
+    const double wall = static_cast<double>(wall_ns_);
+    os << "PROFILE batches=" << batches_ << " events=" << events_
+       << " wall_ms=" << wall / 1e6;
+    if (q::alloc::installed()) os << " allocs=" << allocs_ << " allocs_per_batch=" << allocs_per_batch();
+    else os << " allocs=n/a";
+    os << " perf=" << (perf_ok_ ? "on" : "off") << "\n";
+
+    os << std::left << std::setw(15) << "phase" << std::right
+       << std::setw(10) << "calls" << std::setw(11) << "wall_ms" << std::setw(8) << "%wall"
+       << std::setw(10) << "ns/call" << std::setw(11) << "allocs" << std::setw(11) << "dispatch"
+       << std::setw(10) << "inline" << std::setw(8) << "skew";
+    if (perf_ok_) os << std::setw(14) << "cycles" << std::setw(7) << "ipc" << std::setw(12) << "llc_miss";
+    os << "\n";
+    for (std::size_t k = 0; k < kPhaseCount; ++k) {
+      const auto& s = phases_[k];
+      if (s.calls == 0) continue;
+      const double w = static_cast<double>(s.wall_ns);
+      os << std::left << std::setw(15) << kPhaseNames[k] << std::right << std::fixed
+         << std::setw(10) << s.calls
+         << std::setprecision(2) << std::setw(11) << w / 1e6
+         << std::setprecision(1) << std::setw(8) << (wall > 0 ? 100.0 * w / wall : 0.0)
+         << std::setprecision(0) << std::setw(10) << w / static_cast<double>(s.calls)
+         << std::setw(11) << s.allocs
+         << std::setw(11) << s.dispatches
+         << std::setw(10) << s.inline_runs
+         << std::setprecision(2) << std::setw(8) << s.skew();
+      if (perf_ok_) {
+        const double ipc = s.perf.cycles ? static_cast<double>(s.perf.instructions) / static_cast<double>(s.perf.cycles) : 0.0;
+        os << std::setw(14) << s.perf.cycles << std::setw(7) << ipc << std::setw(12) << s.perf.llc_misses;
+      }
+      os << std::defaultfloat << std::setprecision(6) << "\n";
+    }
+
+    os << std::left << std::setw(15) << "worker" << std::right
+       << std::setw(11) << "busy_ms" << std::setw(11) << "wait_ms"
+       << std::setw(10) << "syms" << std::setw(12) << "events" << "\n";
+    for (std::size_t w = 0; w < workers_.size(); ++w) {
+      const auto& s = workers_[w];
+      os << std::left << std::setw(15) << w << std::right << std::fixed << std::setprecision(2)
+         << std::setw(11) << static_cast<double>(s.busy_ns) / 1e6
+         << std::setw(11) << static_cast<double>(s.wait_ns) / 1e6
+         << std::setw(10) << s.syms
+         << std::setw(12) << s.events
+         << std::defaultfloat << std::setprecision(6) << "\n";
+    }
+  }
+
+  // 回归跟踪用：一个对象，时间单位 ns
+  void write_json(std::ostream& os) const {
+    os << "{\"batches\":" << batches_
+       << ",\"events\":" << events_
+       << ",\"wall_ns\":" << wall_ns_
+       << ",\"allocs_counted\":" << (q::alloc::installed() ? "true" : "false")
+       << ",\"allocs\":" << allocs_
+       << ",\"allocs_per_batch\":" << allocs_per_batch()
+       << ",\"perf_counters\":" << (perf_ok_ ? "true" : "false")
+       << ",\"phases\":[";
+    bool first = true;
+    for (std::size_t k = 0; k < kPhaseCount; ++k) {
+      const auto& s = phases_[k];
+      if (!first) os << ",";
+      first = false;
+      os << "{\"name\":\"" << kPhaseNames[k] << "\""
+         << ",\"calls\":" << s.calls
+         << ",\"wall_ns\":" << s.wall_ns
+         << ",\"allocs\":" << s.allocs
+         << ",\"dispatches\":" << s.dispatches
+         << ",\"inline_runs\":" << s.inline_runs
+         << ",\"skew\":" << s.skew();
+      if (perf_ok_) {
+        os << ",\"cycles\":" << s.perf.cycles
+           << ",\"instructions\":" << s.perf.instructions
+           << ",\"llc_misses\":" << s.perf.llc_misses;
+      }
+      os << "}";
+    }
+    os << "],\"workers\":[";
+    for (std::size_t w = 0; w < workers_.size(); ++w) {
+      const auto& s = workers_[w];
+      if (w) os << ",";
+      os << "{\"busy_ns\":" << s.busy_ns
+         << ",\"wait_ns\":" << s.wait_ns
+         << ",\"syms\":" << s.syms
+         << ",\"events\":" << s.events << "}";
+    }
+    os << "]}\n";
+  }
+
+private:
+  std::array<PhaseStats, kPhaseCount> phases_{};
+  std::vector<WorkerStats> workers_;
+  std::uint64_t batches_{0};
+  std::uint64_t events_{0};
+  std::uint64_t wall_ns_{0};
+  std::uint64_t allocs_{0};
+  bool perf_ok_{false};
+  q::PerfCounters perf_;
+};
+
+// 主线程 phase 计时；prof == nullptr（profile 关闭）时什么都不做
+class PhaseTimer {
+public:
+  PhaseTimer(EngineProfile* prof, Phase p) : prof_(prof), p_(p) {
+    if (prof_) m0_ = prof_->mark();
+  }
+  ~PhaseTimer() {
+    if (prof_) prof_->add(p_, m0_);
+  }
+  PhaseTimer(const PhaseTimer&) = delete;
+  PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+  EngineProfile* prof_;
+  Phase p_;
+  EngineProfile::Mark m0_{};
+};
+
+} // namespace bt3
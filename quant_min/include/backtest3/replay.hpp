@@ -1,22 +1,318 @@
 #pragma once
+#include <atomic>
+#include <cassert>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 
+#include "backtest3/io_prefetcher.hpp"
 #include "market/event.hpp"
+#include "market/event_io.hpp"
 
 namespace bt3 {
 
+// 事件流只读共享：多个 replay（例如参数 sweep 里并发的多个 engine）可以指向同一份解码后的数据
+using SharedEvents = std::shared_ptr<const std::vector<q::market::MarketEvent>>;
+
 class VectorReplay {
 public:
   explicit VectorReplay(std::vector<q::market::MarketEvent> events)
-      : events_(std::move(events)) {}
+      : events_(std::make_shared<const std::vector<q::market::MarketEvent>>(std::move(events))) {}
+
+  explicit VectorReplay(SharedEvents events) : events_(std::move(events)) {}
+
+  bool has_next(std::size_t idx) const { return idx < events_->size(); }
+  const q::market::MarketEvent& peek(std::size_t idx) const { return (*events_)[idx]; }
+  q::market::MarketEvent next(std::size_t& idx) { return (*events_)[idx++]; }
+
+  const SharedEvents& events() const { return events_; }
+
+private:
+  SharedEvents events_;
+};
+
+struct FileReplayConfig {
+  std::size_t block_events{1024}; // 每块事件数；常驻内存 ~ block_events * sizeof(MarketEvent)
+};
+
+// 按块从磁盘流式读取一个 symbol 的事件，与 VectorReplay 同一套 cursor 接口
+// - paths：按时间顺序的多个文件（多日），逻辑上首尾相接；格式按文件头自动识别（binary / CSV）
+// - 内存里只有当前一块：[base_, base_ + block_.size()) 这段 cursor 可 peek
+// - 每读一块才打开一次文件（记住偏移量），不长期占 fd —— 几千个 symbol 不会撞 ulimit
+// - cursor 只能前进（scheduler 就是这样用的）；回到 base_ 之前会从头重读
+// - attach(IoPrefetcher) 后双缓冲：消费 block_ 时后台把下一块读进 back_；
+//   主线程用到时 back_ 还在排队就撤回请求自己读（不会因预算卡死），正在读就等它
+// - stall_ns()：主线程等 I/O 的总时间（同步读 + 等预读）
+class FileReplay {
+public:
+  explicit FileReplay(std::vector<std::string> paths, FileReplayConfig cfg = {})
+      : paths_(std::move(paths)), cfg_(cfg) {
+    if (cfg_.block_events == 0) cfg_.block_events = 1;
+    block_.reserve(cfg_.block_events);
+    rewind();
+  }
+
+  ~FileReplay() { detach(); }
+
+  FileReplay(FileReplay&& o) noexcept
+      : paths_(std::move(o.paths_)), cfg_(o.cfg_), block_(std::move(o.block_)), base_(o.base_),
+        rd_(o.rd_), done_(o.done_), raw_(std::move(o.raw_)),
+        blocks_read_(o.blocks_read_), bytes_read_(o.bytes_read_), bad_lines_(o.bad_lines_),
+        stall_ns_(o.stall_ns_), prefetch_hits_(o.prefetch_hits_) {
+    assert(o.prefetch_ == nullptr); // 只在 attach 之前移动（例如 vector 扩容）
+  }
+  FileReplay(const FileReplay&) = delete;
+  FileReplay& operator=(const FileReplay&) = delete;
+  FileReplay& operator=(FileReplay&&) = delete;
+
+  void attach(IoPrefetcher* p) {
+    detach();
+    prefetch_ = p;
+    back_.reserve(cfg_.block_events);
+    request_prefetch();
+  }
+
+  bool has_next(std::size_t idx) {
+    ensure(idx);
+    return idx - base_ < block_.size();
+  }
+
+  const q::market::MarketEvent& peek(std::size_t idx) {
+    ensure(idx);
+    assert(idx - base_ < block_.size());
+    return block_[idx - base_];
+  }
+
+  q::market::MarketEvent next(std::size_t& idx) {
+    auto e = peek(idx);
+    ++idx;
+    return e;
+  }
+
+  // resume：直接定位到 cursor idx（之后 peek(idx) 起有效）。binary 文件按文件大小整文件跳过、
+  // 文件内按记录偏移跳；CSV 无法定位，从该文件开头顺读到 idx
+  void seek(std::size_t idx) {
+    using namespace q::market::bin;
+    cancel_or_wait_back();
+    base_ = 0;
+    block_.clear();
+    rd_ = ReadPos{};
+    done_ = false;
+    while (rd_.file < paths_.size() && is_binary_file(paths_[rd_.file])) {
+      std::error_code ec;
+      const auto sz = static_cast<std::size_t>(std::filesystem::file_size(paths_[rd_.file], ec));
+      if (ec) break;
+      const std::size_t n = sz > kHeaderBytes ? (sz - kHeaderBytes) / kRecordBytes : 0;
+      if (idx - base_ < n) {
+        rd_.format_known = true;
+        rd_.binary = true;
+        rd_.offset = kHeaderBytes + (idx - base_) * kRecordBytes;
+        base_ = idx;
+        break;
+      }
+      base_ += n;
+      ++rd_.file;
+    }
+    rd_.eof = rd_.file >= paths_.size();
+    request_prefetch();
+    ensure(idx);
+  }
+
+  std::size_t blocks_read() const { return blocks_read_; }
+  std::size_t bytes_read() const { return bytes_read_; }
+  std::size_t bad_lines() const { return bad_lines_; }
+  std::int64_t stall_ns() const { return stall_ns_; }
+  std::size_t prefetch_hits() const { return prefetch_hits_; }
+  const std::vector<std::string>& paths() const { return paths_; }
+
+private:
+  // 读盘位置：同一时刻只归一个线程（主线程同步读，或抢到 InFlight 的 I/O 线程）
+  struct ReadPos {
+    std::size_t file{0};
+    std::size_t offset{0}; // 当前文件内下一次读的字节偏移
+    bool format_known{false};
+    bool binary{false};
+    bool eof{false};
+  };
 
-  bool has_next(std::size_t idx) const { return idx < events_.size(); }
-  const q::market::MarketEvent& peek(std::size_t idx) const { return events_[idx]; }
-  q::market::MarketEvent next(std::size_t& idx) { return events_[idx++]; }
+  enum BackState : std::uint32_t { kEmpty, kQueued, kInFlight, kReady };
+
+  std::size_t block_bytes() const { return cfg_.block_events * sizeof(q::market::MarketEvent); }
+
+  void rewind() {
+    cancel_or_wait_back();
+    base_ = 0;
+    block_.clear();
+    rd_ = ReadPos{};
+    rd_.eof = paths_.empty();
+    done_ = paths_.empty();
+    request_prefetch();
+  }
+
+  void detach() {
+    if (!prefetch_) return;
+    cancel_or_wait_back();
+    prefetch_->forget(this);
+    prefetch_ = nullptr;
+  }
+
+  void ensure(std::size_t idx) {
+    if (idx < base_) rewind();
+    while (idx - base_ >= block_.size() && !done_) next_block();
+  }
+
+  void next_block() {
+    base_ += block_.size();
+    block_.clear();
+
+    const auto t0 = std::chrono::steady_clock::now();
+    bool hit = false;
+    if (prefetch_) {
+      auto st = static_cast<std::uint32_t>(kQueued);
+      // 还在排队：撤回，自己读（I/O 线程之后拿到这个请求会 CAS 失败并归还预算）
+      if (!back_state_.compare_exchange_strong(st, kEmpty, std::memory_order_acq_rel)) {
+        while ((st = back_state_.load(std::memory_order_acquire)) == kInFlight) back_state_.wait(kInFlight);
+        if (st == kReady) {
+          block_.swap(back_);
+          back_.clear();
+          back_state_.store(kEmpty, std::memory_order_relaxed);
+          prefetch_->release(block_bytes());
+          hit = true;
+        }
+      }
+    }
+    if (!hit) fill(block_);
+    stall_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+    if (hit) ++prefetch_hits_;
+
+    if (block_.empty()) {
+      done_ = true;
+      return;
+    }
+    request_prefetch();
+  }
+
+  // 以当前块最后一个事件的 ts 为优先级：越早用完越先读
+  void request_prefetch() {
+    if (!prefetch_ || rd_.eof) return;
+    back_state_.store(kQueued, std::memory_order_release);
+    const auto prio = block_.empty() ? std::int64_t{0} : block_.back().ts_ns;
+    prefetch_->submit(prio, block_bytes(), this, &FileReplay::run_prefetch);
+  }
+
+  static bool run_prefetch(void* ctx) {
+    auto* self = static_cast<FileReplay*>(ctx);
+    auto st = static_cast<std::uint32_t>(kQueued);
+    if (!self->back_state_.compare_exchange_strong(st, kInFlight, std::memory_order_acq_rel)) return false;
+    self->fill(self->back_);
+    self->back_state_.store(kReady, std::memory_order_release);
+    self->back_state_.notify_all();
+    return true;
+  }
+
+  // 撤回排队中的预读；正在读就等它读完再丢弃
+  void cancel_or_wait_back() {
+    if (!prefetch_) return;
+    auto st = static_cast<std::uint32_t>(kQueued);
+    if (back_state_.compare_exchange_strong(st, kEmpty, std::memory_order_acq_rel)) return;
+    while ((st = back_state_.load(std::memory_order_acquire)) == kInFlight) back_state_.wait(kInFlight);
+    if (st == kReady) {
+      back_.clear();
+      back_state_.store(kEmpty, std::memory_order_relaxed);
+      prefetch_->release(block_bytes());
+    }
+  }
+
+  // 从 rd_ 处读满一块到 out（可以跨文件）；全部读完置 rd_.eof
+  void fill(std::vector<q::market::MarketEvent>& out) {
+    out.clear();
+    while (out.size() < cfg_.block_events && rd_.file < paths_.size()) {
+      if (!read_from_file(out)) {
+        ++rd_.file;
+        rd_.offset = 0;
+        rd_.format_known = false;
+      }
+    }
+    ++blocks_read_;
+    if (rd_.file >= paths_.size()) rd_.eof = true;
+  }
+
+  // 从当前文件 rd_.offset 处补满 out；文件读完返回 false
+  bool read_from_file(std::vector<q::market::MarketEvent>& out) {
+    const auto& path = paths_[rd_.file];
+    if (!rd_.format_known) {
+      rd_.binary = q::market::bin::is_binary_file(path);
+      rd_.format_known = true;
+      if (rd_.binary) rd_.offset = q::market::bin::kHeaderBytes;
+    }
+    return rd_.binary ? read_binary(path, out) : read_csv(path, out);
+  }
+
+  bool read_binary(const std::string& path, std::vector<q::market::MarketEvent>& out) {
+    using namespace q::market::bin;
+    std::ifstream f(path, std::ios::binary);
+    if (!f) return false;
+    f.seekg(static_cast<std::streamoff>(rd_.offset));
+
+    const auto want = cfg_.block_events - out.size();
+    raw_.resize(want * kRecordBytes);
+    f.read(raw_.data(), static_cast<std::streamsize>(raw_.size()));
+    const auto got = static_cast<std::size_t>(f.gcount()) / kRecordBytes;
+    for (std::size_t k = 0; k < got; ++k) out.push_back(decode(raw_.data() + k * kRecordBytes));
+
+    rd_.offset += got * kRecordBytes;
+    bytes_read_ += got * kRecordBytes;
+    return got == want;
+  }
+
+  bool read_csv(const std::string& path, std::vector<q::market::MarketEvent>& out) {
+    std::ifstream f(path);
+    if (!f) return false;
+    f.seekg(static_cast<std::streamoff>(rd_.offset));
+
+    std::string line;
+    while (out.size() < cfg_.block_events && std::getline(f, line)) {
+      rd_.offset += line.size() + 1;
+      bytes_read_ += line.size() + 1;
+      if (line.empty() || line[0] == '#') continue;
+      q::market::MarketEvent e{};
+      if (q::market::parse_csv_event(line, e)) {
+        out.push_back(e);
+      } else if (line.rfind("ts_ns", 0) != 0) {
+        ++bad_lines_;
+      }
+    }
+    return out.size() == cfg_.block_events;
+  }
 
 private:
-  std::vector<q::market::MarketEvent> events_;
+  std::vector<std::string> paths_;
+  FileReplayConfig cfg_;
+
+  std::vector<q::market::MarketEvent> block_;
+  std::size_t base_{0}; // block_[0] 对应的 cursor
+
+  ReadPos rd_;
+  bool done_{false};
+
+  // prefetch 双缓冲
+  IoPrefetcher* prefetch_{nullptr};
+  std::vector<q::market::MarketEvent> back_;
+  std::atomic<std::uint32_t> back_state_{kEmpty};
+
+  // 以下只由当前持有 rd_ 的线程写；run 结束后再读
+  std::string raw_;
+  std::size_t blocks_read_{0};
+  std::size_t bytes_read_{0};
+  std::size_t bad_lines_{0};
+  std::int64_t stall_ns_{0};
+  std::size_t prefetch_hits_{0};
 };
 
 } // namespace bt3
@@ -1,8 +1,9 @@
 #pragma once
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
-#include <queue>
-#include <tuple>
-#include <unordered_map>
+#include <limits>
+#include <utility>
 #include <vector>
 
 #include "backtest3/replay.hpp"
@@ -10,78 +11,243 @@
 
 namespace bt3 {
 // A scheduler that returns sym_idx with event (because MarketEvent doesn't include symbol).
-  class SymBatchScheduler {
+//
+// k 路归并用 loser tree（败者树）：
+// - 叶子 = 每个 symbol 的 replay 游标，key = (ts, seq, sym_idx)，与旧 priority_queue 的出队顺序完全一致
+// - 内部节点只存“败者”叶子号，出一个事件后只沿该叶子到根走一遍，每层 1 次比较，无 push/pop
+// - 叶子数补齐到 2 的幂，多出来的叶子是永远输的哨兵
+// - batch 通过 sink 直接交给调用方（engine 边归并边分桶），或写进复用的 buffer
+// - ReplayT 只需 has_next(idx) / peek(idx) 的 cursor 接口（VectorReplay / FileReplay）
+template <class ReplayT>
+  class BasicSymBatchScheduler {
   public:
     using Item = std::pair<std::size_t, q::market::MarketEvent>; // (sym_idx, event)
 
-    explicit SymBatchScheduler(const std::vector<VectorReplay*>& replays,
-                               std::int64_t instruments_count)
-        : replays_(replays), instruments_count_(instruments_count) {
+    explicit BasicSymBatchScheduler(const std::vector<ReplayT*>& replays,
+                                    std::int64_t instruments_count)
+        : replays_(replays.begin(), replays.begin() + instruments_count) {
       init();
     }
 
-    bool has_next() const { return !heap_.empty(); }
+    bool has_next() const { return leaves_[tree_[0]].ts != kDone; }
 
-    std::vector<Item> next_batch_same_ts() {
-      std::vector<Item> batch;
-      if (!has_next()) return batch;
+    // 下一个事件的 ts（has_next() 为 true 时有效）
+    std::int64_t peek_ts() const { return leaves_[tree_[0]].ts; }
 
-      auto first = next_one();
-      const auto ts = first.second.ts_ns;
-      batch.push_back(first);
+    // 最近一次取出的 batch 的 ts
+    std::int64_t batch_ts() const { return batch_ts_; }
 
-      while (has_next()) {
-        auto top = heap_.top();
-        if (std::get<0>(top) != ts) break;
-        batch.push_back(next_one());
+    // 文件型 replay：主线程等 I/O 的累计时间（engine 的 DONE 行会打印）
+    std::int64_t io_stall_ns() const
+      requires requires(const ReplayT& r) { r.stall_ns(); }
+    {
+      std::int64_t ns = 0;
+      for (auto const* rp : replays_) ns += rp->stall_ns();
+      return ns;
+    }
+
+    // 取出下一个同 ts batch，逐个调用 sink(sym_idx, const MarketEvent&)，返回事件数
+    template <class Sink>
+    std::size_t next_batch_into(Sink&& sink) {
+      if (!has_next()) return 0;
+
+      const auto ts = peek_ts();
+      batch_ts_ = ts;
+      std::size_t n = 0;
+      do {
+        const auto w = tree_[0];
+        auto& leaf = leaves_[w];
+        auto* rp = replays_[w];
+        sink(w, rp->peek(leaf.cur));
+        ++leaf.cur;
+        load_key(w);
+        replay(w);
+        ++n;
+      } while (leaves_[tree_[0]].ts == ts);
+      return n;
+    }
+
+    // checkpoint：symbol 的 replay 游标（下一个要出的事件下标）
+    std::size_t cursor(std::size_t sym_idx) const { return leaves_[sym_idx].cur; }
+
+    // resume：各 symbol 游标设为 cur[i] 后重建败者树；replay 有 seek(idx) 时（FileReplay）先让它跳过去
+    void seek(const std::vector<std::size_t>& cur) {
+      for (std::size_t i = 0; i < replays_.size() && i < cur.size(); ++i) {
+        if constexpr (requires(ReplayT& r) { r.seek(std::size_t{0}); }) replays_[i]->seek(cur[i]);
+        leaves_[i].cur = cur[i];
       }
-      return batch;
+      build();
+    }
+
+    // 兼容接口：batch 写进内部复用的 buffer（下次调用前有效）
+    const std::vector<Item>& next_batch_same_ts() {
+      batch_.clear();
+      next_batch_into([this](std::size_t sym_idx, const q::market::MarketEvent& e) {
+        batch_.emplace_back(sym_idx, e);
+      });
+      return batch_;
     }
 
   private:
-    using Node = std::tuple<std::int64_t, std::int64_t, std::size_t, std::size_t>;
-    // (ts, seq, sym_idx, cursor)
-
-    struct Cmp {
-      bool operator()(const Node& a, const Node& b) const {
-        if (std::get<0>(a) != std::get<0>(b)) return std::get<0>(a) > std::get<0>(b);
-        if (std::get<1>(a) != std::get<1>(b)) return std::get<1>(a) > std::get<1>(b);
-        return std::get<2>(a) > std::get<2>(b);
-      }
+    static constexpr std::int64_t kDone = std::numeric_limits<std::int64_t>::max();
+
+    struct Leaf {
+      std::int64_t ts{kDone};
+      std::int64_t seq{kDone};
+      std::size_t cur{0};
     };
 
-    void init() {
-      while (!heap_.empty()) heap_.pop();
-      for (std::size_t sym_idx = 0; sym_idx < instruments_count_; ++sym_idx) {
-        auto* rp = replays_[sym_idx];
-        std::size_t cur = 0;
-        if (rp->has_next(cur)) {
-          const auto& ev = rp->peek(cur);
-          heap_.push(Node{ev.ts_ns, ev.seq, sym_idx, cur});
-        }
+    // a 是否先于 b 出队
+    bool before(std::size_t a, std::size_t b) const {
+      const auto& x = leaves_[a];
+      const auto& y = leaves_[b];
+      if (x.ts != y.ts) return x.ts < y.ts;
+      if (x.seq != y.seq) return x.seq < y.seq;
+      return a < b;
+    }
+
+    void load_key(std::size_t i) {
+      auto& leaf = leaves_[i];
+      if (i < replays_.size() && replays_[i]->has_next(leaf.cur)) {
+        const auto& ev = replays_[i]->peek(leaf.cur);
+        leaf.ts = ev.ts_ns;
+        leaf.seq = ev.seq;
+      } else {
+        leaf.ts = kDone;
+        leaf.seq = kDone;
       }
     }
 
-    Item next_one() {
-      auto top = heap_.top();
-      heap_.pop();
+    void init() {
+      m_ = 1;
+      while (m_ < replays_.size()) m_ <<= 1;
+      leaves_.assign(m_, Leaf{});
+      build();
+    }
 
-      const auto sym_idx = std::get<2>(top);
-      auto cur = std::get<3>(top);
-      auto* rp = replays_[sym_idx];
-      auto ev = rp->next(cur);
+    void build() {
+      for (std::size_t i = 0; i < m_; ++i) load_key(i);
 
-      if (rp->has_next(cur)) {
-        const auto& nxt = rp->peek(cur);
-        heap_.push(Node{nxt.ts_ns, nxt.seq, sym_idx, cur});
+      // 自底向上：winners[node] 为子树胜者，tree_[node] 记败者；tree_[0] 为总胜者
+      tree_.assign(m_, 0);
+      std::vector<std::size_t> winners(2 * m_);
+      for (std::size_t i = 0; i < m_; ++i) winners[m_ + i] = i;
+      for (std::size_t node = m_ - 1; node >= 1; --node) {
+        const auto a = winners[2 * node];
+        const auto b = winners[2 * node + 1];
+        if (before(a, b)) {
+          winners[node] = a;
+          tree_[node] = b;
+        } else {
+          winners[node] = b;
+          tree_[node] = a;
+        }
       }
-      return {sym_idx, ev};
+      tree_[0] = winners[1];
+    }
+
+    // 叶子 w 的 key 变了：沿路径与各层败者比较，胜者继续上行
+    void replay(std::size_t w) {
+      std::size_t winner = w;
+      for (std::size_t node = (m_ + w) >> 1; node >= 1; node >>= 1) {
+        if (before(tree_[node], winner)) std::swap(tree_[node], winner);
+      }
+      tree_[0] = winner;
     }
 
   private:
-    const std::vector<VectorReplay*>& replays_;
-    std::int64_t instruments_count_;
-    std::priority_queue<Node, std::vector<Node>, Cmp> heap_;
+    std::vector<ReplayT*> replays_;
+    std::size_t m_{1};            // 叶子数（2 的幂）
+    std::vector<Leaf> leaves_;
+    std::vector<std::size_t> tree_; // [0] = winner, [1..m_) = losers
+    std::int64_t batch_ts_{0};
+    std::vector<Item> batch_;
   };
 
+// 预读包装：先从底层 scheduler 取出至多 depth 个 batch 缓存起来，对外接口同 BasicSymBatchScheduler
+// - ahead() / ahead_ts(k)：已预读、还没交出去的 batch 的 ts（升序）；more()：预读之外底层是否还有数据
+// - 分片用：向 coordinator 报告接下来的 ts，coordinator 据此一次放行一段 ts（见 shard.hpp）
+// - cursor / seek 扣掉缓存里的事件，checkpoint 语义与底层一致
+template <class SchedulerT>
+class LookaheadScheduler {
+public:
+  using Item = typename SchedulerT::Item;
+
+  LookaheadScheduler(SchedulerT& inner, std::size_t depth) : inner_(inner), slots_(std::max<std::size_t>(depth, 1)) {
+    fill();
+  }
+
+  bool has_next() const { return n_ > 0; }
+  std::int64_t peek_ts() const { return slots_[head_].ts; }
+  std::int64_t batch_ts() const { return batch_ts_; }
+
+  std::size_t ahead() const { return n_; }
+  std::int64_t ahead_ts(std::size_t k) const { return slots_[(head_ + k) % slots_.size()].ts; }
+  bool more() const { return inner_.has_next(); }
+
+  std::int64_t io_stall_ns() const
+    requires requires(const SchedulerT& s) { s.io_stall_ns(); }
+  {
+    return inner_.io_stall_ns();
+  }
+
+  template <class Sink>
+  std::size_t next_batch_into(Sink&& sink) {
+    if (n_ == 0) return 0;
+    auto& slot = slots_[head_];
+    batch_ts_ = slot.ts;
+    for (auto const& it : slot.items) {
+      --buffered_[it.first];
+      sink(it.first, it.second);
+    }
+    const auto n = slot.items.size();
+    head_ = (head_ + 1) % slots_.size();
+    --n_;
+    fill();
+    return n;
+  }
+
+  std::size_t cursor(std::size_t sym_idx) const {
+    return inner_.cursor(sym_idx) - (sym_idx < buffered_.size() ? buffered_[sym_idx] : 0);
+  }
+
+  void seek(const std::vector<std::size_t>& cur) {
+    inner_.seek(cur);
+    head_ = 0;
+    n_ = 0;
+    std::fill(buffered_.begin(), buffered_.end(), 0);
+    fill();
+  }
+
+private:
+  struct Slot {
+    std::int64_t ts{0};
+    std::vector<Item> items;
+  };
+
+  void fill() {
+    while (n_ < slots_.size() && inner_.has_next()) {
+      auto& slot = slots_[(head_ + n_) % slots_.size()];
+      slot.items.clear();
+      inner_.next_batch_into([this, &slot](std::size_t sym_idx, const q::market::MarketEvent& e) {
+        if (sym_idx >= buffered_.size()) buffered_.resize(sym_idx + 1, 0);
+        ++buffered_[sym_idx];
+        slot.items.emplace_back(sym_idx, e);
+      });
+      slot.ts = inner_.batch_ts();
+      ++n_;
+    }
+  }
+
+  SchedulerT& inner_;
+  std::vector<Slot> slots_; // 环形缓冲
+  std::size_t head_{0};
+  std::size_t n_{0};
+  std::vector<std::size_t> buffered_; // 每个 symbol 在缓存里的事件数
+  std::int64_t batch_ts_{0};
+};
+
+using SymBatchScheduler = BasicSymBatchScheduler<VectorReplay>;
+using FileBatchScheduler = BasicSymBatchScheduler<FileReplay>;
+
 } // namespace bt3
@@ -0,0 +1,520 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "common/serialize.hpp"
+#include "backtest3/portfolio.hpp" // PortfolioAggregates
+#include "backtest3/portfolio_risk.hpp"
+
+namespace bt3 {
+
+// 分片回测：symbol 按连续区间切给多个进程，每个进程一个 MultiSymbolEngine（ShardLink 挂在 engine 上），
+// coordinator 进程按全局 ts 推进，一次放行一段（window）：
+// - 分片在 window 边界报告 预读到的接下来至多 K 个有事件的 ts（LookaheadScheduler）+ 本分片的组合汇总，
+//   以及上一段里每一轮结束时的 equity
+// - coordinator 取 horizon = 还有后续数据的分片所报最后一个 ts 的最小值，把各分片所报 <= horizon 的 ts
+//   合并去重、最多取 K 个作为下一段，连同其余分片的汇总发给全部分片（GO）；分片跑完这一段再报告
+// - 每个全局 ts 每个分片都跑一轮（没有事件的分片跳过 Phase A，策略照常按全局 batch 采样，与单进程一致）；
+//   全部分片跑完后发空的 GO 收尾
+// - 组合风控不开时 symbol 之间没有耦合，结果与单进程逐笔一致（与 K、分片数都无关），K 越大往返越少
+// - 组合风控开时，分片看到的其余分片敞口 / equity 是上一段结束时的值（最多滞后 K 轮），结果与单进程不同，
+//   只取决于数据、分片数与 K（与进程调度无关）；K = 1 时每段一个 ts，滞后一轮
+// 传输：socketpair（fork 出的分片）、AF_UNIX 路径或 TCP host:port；一条消息 = u32 payload 长度 | u8 类型 | payload（q::ser）
+
+inline constexpr std::int64_t kShardEnd = std::numeric_limits<std::int64_t>::max(); // horizon 不受限
+
+// n 个 symbol 切成 n_shards 段，第 k 段为 [first, last)
+struct ShardRange {
+  std::size_t first{0};
+  std::size_t last{0};
+};
+inline ShardRange shard_range(std::size_t n, std::size_t k, std::size_t n_shards) {
+  return {n * k / n_shards, n * (k + 1) / n_shards};
+}
+
+// 分片的组合风控配置：sym_group 按全局 symbol 编号给出，分片内 sym_idx 从 0 起 => 切出 [first, last) 那段
+// （超出 sym_group 长度的 symbol 本来就按组 0，切片后同样）；限额按组号，不用改
+inline PortfolioRiskConfig shard_config(const PortfolioRiskConfig& cfg, ShardRange r) {
+  PortfolioRiskConfig out = cfg;
+  const auto n = cfg.sym_group.size();
+  out.sym_group.assign(cfg.sym_group.begin() + static_cast<std::ptrdiff_t>(std::min(r.first, n)),
+                       cfg.sym_group.begin() + static_cast<std::ptrdiff_t>(std::min(r.last, n)));
+  return out;
+}
+
+// 分片跑完后交给 coordinator 的 RunStats 子集
+struct ShardResult {
+  std::uint64_t batches{0}; // = coordinator 的轮数
+  std::uint64_t events{0};
+  std::uint64_t fills{0};
+  std::uint64_t prisk_rejects{0};
+  std::uint64_t fill_digest{0};
+  double wall_s{0.0};
+};
+
+namespace shard {
+
+enum class Msg : std::uint8_t { Hello = 1, Report, Go, Final };
+
+inline constexpr std::size_t kHeader = 5;
+inline constexpr std::uint32_t kMaxPayload = 1u << 30;
+
+inline bool send_all(int fd, const char* p, std::size_t n) {
+  while (n > 0) {
+    const auto k = ::send(fd, p, n, MSG_NOSIGNAL);
+    if (k < 0 && errno == EINTR) continue;
+    if (k <= 0) return false;
+    p += k;
+    n -= static_cast<std::size_t>(k);
+  }
+  return true;
+}
+
+inline bool recv_all(int fd, char* p, std::size_t n) {
+  while (n > 0) {
+    const auto k = ::recv(fd, p, n, 0);
+    if (k < 0 && errno == EINTR) continue;
+    if (k <= 0) return false;
+    p += k;
+    n -= static_cast<std::size_t>(k);
+  }
+  return true;
+}
+
+// buf 先放帧头占位，之后用 q::ser::Writer 追加 payload，send_msg 补长度后一次写出
+inline void begin(std::string& buf, Msg t) {
+  buf.assign(kHeader, '\0');
+  buf[4] = static_cast<char>(t);
+}
+
+inline bool send_msg(int fd, std::string& buf) {
+  const auto n = static_cast<std::uint32_t>(buf.size() - kHeader);
+  std::memcpy(buf.data(), &n, sizeof(n));
+  return send_all(fd, buf.data(), buf.size());
+}
+
+inline bool recv_msg(int fd, Msg& t, std::string& payload) {
+  char hdr[kHeader];
+  if (!recv_all(fd, hdr, sizeof(hdr))) return false;
+  std::uint32_t n = 0;
+  std::memcpy(&n, hdr, sizeof(n));
+  if (n > kMaxPayload) return false;
+  t = static_cast<Msg>(static_cast<std::uint8_t>(hdr[4]));
+  payload.resize(n);
+  return n == 0 || recv_all(fd, payload.data(), n);
+}
+
+inline void put(q::ser::Writer& w, const PortfolioAggregates& a) {
+  w.put(a.equity);
+  w.put(a.gross);
+  w.put(a.net);
+  w.put(a.killed);
+  w.put_vec(a.group_gross);
+}
+
+inline void get(q::ser::Reader& r, PortfolioAggregates& a) {
+  r.get(a.equity);
+  r.get(a.gross);
+  r.get(a.net);
+  r.get(a.killed);
+  r.get_vec(a.group_gross);
+}
+
+// 地址："host:port" => TCP（关 Nagle：每轮消息都很小、在关键路径上）；其它当作 AF_UNIX 路径
+inline bool is_tcp(const std::string& addr) {
+  return addr.find('/') == std::string::npos && addr.find(':') != std::string::npos;
+}
+
+inline void set_nodelay(int fd) {
+  const int one = 1;
+  ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+// passive：bind + listen；否则 connect。返回 fd，失败 -1
+inline int open_socket(const std::string& addr, bool passive, int backlog) {
+  if (is_tcp(addr)) {
+    const auto c = addr.rfind(':');
+    const std::string host = addr.substr(0, c);
+    const std::string port = addr.substr(c + 1);
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    addrinfo* res = nullptr;
+    if (::getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &res) != 0) return -1;
+    int fd = -1;
+    for (auto* ai = res; ai; ai = ai->ai_next) {
+      fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (fd < 0) continue;
+      if (passive) {
+        const int one = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (::bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && ::listen(fd, backlog) == 0) break;
+      } else if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+        set_nodelay(fd);
+        break;
+      }
+      ::close(fd);
+      fd = -1;
+    }
+    ::freeaddrinfo(res);
+    return fd;
+  }
+
+  sockaddr_un sa{};
+  if (addr.empty() || addr.size() >= sizeof(sa.sun_path)) return -1;
+  sa.sun_family = AF_UNIX;
+  std::memcpy(sa.sun_path, addr.c_str(), addr.size() + 1);
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  if (passive) {
+    ::unlink(addr.c_str()); // 上次没清掉的 socket 文件
+    if (::bind(fd, reinterpret_cast<const sockaddr*>(&sa), sizeof(sa)) == 0 && ::listen(fd, backlog) == 0) return fd;
+  } else if (::connect(fd, reinterpret_cast<const sockaddr*>(&sa), sizeof(sa)) == 0) {
+    return fd;
+  }
+  ::close(fd);
+  return -1;
+}
+
+inline int listen_on(const std::string& addr, int backlog) { return open_socket(addr, true, backlog); }
+
+// 分片可能先于 coordinator 启动：在 timeout 内重试
+inline int connect_to(const std::string& addr, std::chrono::milliseconds timeout) {
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  for (;;) {
+    const int fd = open_socket(addr, false, 0);
+    if (fd >= 0 || std::chrono::steady_clock::now() >= deadline) return fd;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+}
+
+inline int accept_one(int lfd, bool tcp) {
+  for (;;) {
+    const int fd = ::accept(lfd, nullptr, nullptr);
+    if (fd < 0 && errno == EINTR) continue;
+    if (fd >= 0 && tcp) set_nodelay(fd);
+    return fd;
+  }
+}
+
+} // namespace shard
+
+// 分片一侧，挂在 MultiSymbolEngine 上（set_shard）：拥有 fd，构造时发 Hello
+// 连接断开 / 协议不符后 good() == false，之后的 report 不再发送，await 返回 false（engine 就此停下）
+class ShardLink {
+public:
+  // 本分片负责全局 symbol [sym_base, sym_base + n_syms)；window = K（须与 coordinator 一致）
+  ShardLink(int fd, std::uint32_t shard_id, std::uint32_t n_shards, std::uint64_t sym_base, std::uint64_t n_syms,
+            std::uint32_t window)
+      : fd_(fd), sym_base_(static_cast<std::size_t>(sym_base)) {
+    shard::begin(out_, shard::Msg::Hello);
+    q::ser::Writer w(out_);
+    w.put(shard_id);
+    w.put(n_shards);
+    w.put(sym_base);
+    w.put(n_syms);
+    w.put(window);
+    ok_ = fd_ >= 0 && shard::send_msg(fd_, out_);
+  }
+
+  ~ShardLink() {
+    if (fd_ >= 0) ::close(fd_);
+  }
+
+  ShardLink(const ShardLink&) = delete;
+  ShardLink& operator=(const ShardLink&) = delete;
+
+  bool good() const { return ok_; }
+  std::uint64_t rounds() const { return rounds_; }
+  std::size_t sym_base() const { return sym_base_; }
+
+  // 当前这一段跑完了（或还没开始）：该 report + await 了
+  bool window_done() const { return pos_ >= window_.size(); }
+  // await 之后：空的一段 = 全部分片都跑完了
+  bool finished() const { return window_.empty(); }
+  // 这一段的下一个全局 ts
+  std::int64_t next_ts() {
+    ++rounds_;
+    return window_[pos_++];
+  }
+  // 每轮结束：本分片 equity，下次 report 一并交给 coordinator（全局回撤逐轮算）
+  void end_round(std::int64_t equity) { equities_.push_back(equity); }
+
+  // 一段结束：本分片接下来有事件的 ts（升序）、预读之外是否还有数据、当前汇总
+  void report(const std::vector<std::int64_t>& ahead, bool more, const PortfolioAggregates& local) {
+    if (!ok_) return;
+    shard::begin(out_, shard::Msg::Report);
+    q::ser::Writer w(out_);
+    w.put_vec(ahead);
+    w.put(more);
+    w.put_vec(equities_);
+    shard::put(w, local);
+    equities_.clear();
+    ok_ = shard::send_msg(fd_, out_);
+  }
+
+  // 阻塞到 coordinator 放行下一段；remote() 是其余分片在上一段结束时的汇总
+  bool await() {
+    if (!ok_) return false;
+    shard::Msg t{};
+    if (!shard::recv_msg(fd_, t, in_) || t != shard::Msg::Go) {
+      ok_ = false;
+      return false;
+    }
+    q::ser::Reader r(in_);
+    r.get_vec(window_);
+    shard::get(r, remote_);
+    pos_ = 0;
+    ok_ = r.ok();
+    return ok_;
+  }
+
+  const PortfolioAggregates& remote() const { return remote_; }
+
+  // run() 返回后：把本分片结果交给 coordinator
+  bool finish(const ShardResult& res) {
+    if (!ok_) return false;
+    shard::begin(out_, shard::Msg::Final);
+    q::ser::Writer w(out_);
+    w.put(res);
+    ok_ = shard::send_msg(fd_, out_);
+    return ok_;
+  }
+
+private:
+  int fd_;
+  std::size_t sym_base_;
+  bool ok_{false};
+  std::uint64_t rounds_{0};
+  std::vector<std::int64_t> window_;
+  std::size_t pos_{0};
+  std::vector<std::int64_t> equities_;
+  std::string out_;
+  std::string in_;
+  PortfolioAggregates remote_;
+};
+
+// coordinator：拥有各分片的 fd（顺序任意，按 Hello 里的 shard_id 归位），run() 按段驱动 lockstep 直到全部分片跑完
+class ShardCoordinator {
+public:
+  struct Stats {
+    std::uint64_t rounds{0}; // 全局 ts 个数（= lockstep 轮数）
+    std::uint64_t windows{0}; // 往返次数（段数）
+    std::int64_t last_ts{-1};
+    double peak_equity{0.0};
+    double max_drawdown{0.0}; // 全局 equity（各分片每轮的 equity 之和）逐轮采样
+    std::uint64_t fill_digest{0}; // 各分片 fill_digest 之和（FillDigest::combine）= 单进程的 fill_digest
+    double wall_s{0.0};
+  };
+
+  // window：每段最多几个 ts（K），须与各分片 ShardLink 的一致
+  ShardCoordinator(std::vector<int> fds, std::uint32_t window) : fds_(std::move(fds)), window_cap_(window) {}
+
+  ~ShardCoordinator() {
+    for (int fd : fds_) {
+      if (fd >= 0) ::close(fd);
+    }
+  }
+
+  ShardCoordinator(const ShardCoordinator&) = delete;
+  ShardCoordinator& operator=(const ShardCoordinator&) = delete;
+
+  bool run() {
+    const auto t0 = std::chrono::steady_clock::now();
+    const std::size_t n = fds_.size();
+    if (n == 0) return fail("no shards");
+
+    std::vector<int> by_id(n, -1);
+    std::vector<std::uint64_t> sym_base(n, 0);
+    n_syms_.assign(n, 0);
+    for (int fd : fds_) {
+      shard::Msg t{};
+      if (!shard::recv_msg(fd, t, in_) || t != shard::Msg::Hello) return fail("bad hello");
+      q::ser::Reader r(in_);
+      const auto id = r.get<std::uint32_t>();
+      const auto n_shards = r.get<std::uint32_t>();
+      const auto base = r.get<std::uint64_t>();
+      const auto n_syms = r.get<std::uint64_t>();
+      const auto window = r.get<std::uint32_t>();
+      if (!r.ok() || n_shards != n || id >= n || by_id[id] >= 0) return fail("shard id / count mismatch");
+      if (window != window_cap_) return fail("shard " + std::to_string(id) + " uses a different --shard-window");
+      by_id[id] = fd;
+      sym_base[id] = base;
+      n_syms_[id] = n_syms;
+    }
+    fds_ = std::move(by_id);
+    // 分片的 symbol 区间须首尾相接（fill_digest 按全局 sym_idx 算）
+    std::uint64_t next_sym = 0;
+    for (std::size_t k = 0; k < n; ++k) {
+      if (sym_base[k] != next_sym) return fail("shard " + std::to_string(k) + " symbol range is not contiguous");
+      next_sym += n_syms_[k];
+    }
+
+    agg_.assign(n, PortfolioAggregates{});
+    ahead_.assign(n, {});
+    more_.assign(n, false);
+    total_ = PortfolioAggregates{};
+    n_killed_ = 0;
+    stats_ = Stats{};
+    window_.clear();
+    for (std::size_t k = 0; k < n; ++k) {
+      if (!read_report(k)) return false;
+    }
+
+    for (;;) {
+      next_window();
+      // 先全部放行再收报告：同一段的分片并行跑
+      for (std::size_t k = 0; k < n; ++k) {
+        if (!send_go(k)) return false;
+      }
+      if (window_.empty()) break;
+      round_eq_.assign(window_.size(), 0);
+      for (std::size_t k = 0; k < n; ++k) {
+        if (!read_report(k)) return false;
+      }
+      ++stats_.windows;
+      stats_.rounds += window_.size();
+      stats_.last_ts = window_.back();
+      for (const auto e : round_eq_) {
+        const double eq = static_cast<double>(e);
+        stats_.peak_equity = std::max(stats_.peak_equity, eq);
+        stats_.max_drawdown = std::max(stats_.max_drawdown, stats_.peak_equity - eq);
+      }
+    }
+
+    results_.assign(n, ShardResult{});
+    std::uint64_t h = 0;
+    for (std::size_t k = 0; k < n; ++k) {
+      shard::Msg t{};
+      if (!shard::recv_msg(fds_[k], t, in_) || t != shard::Msg::Final) return fail("no result from shard " + std::to_string(k));
+      q::ser::Reader r(in_);
+      r.get(results_[k]);
+      if (!r.ok()) return fail("bad result from shard " + std::to_string(k));
+      if (results_[k].batches != stats_.rounds) return fail("shard " + std::to_string(k) + " fell out of lockstep");
+      h += results_[k].fill_digest; // FillDigest::combine
+    }
+    stats_.fill_digest = h;
+    stats_.wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return true;
+  }
+
+  const std::string& error() const { return error_; }
+  const Stats& stats() const { return stats_; }
+  const std::vector<ShardResult>& results() const { return results_; }
+  const std::vector<std::uint64_t>& shard_syms() const { return n_syms_; }
+  // 全部分片之和（最后一次报告时）
+  const PortfolioAggregates& total() const { return total_; }
+
+private:
+  bool fail(std::string msg) {
+    error_ = std::move(msg);
+    return false;
+  }
+
+  // 下一段：horizon 之前所有分片的 ts 都已报告过 => 合并去重后按序取至多 window_cap_ 个
+  void next_window() {
+    std::int64_t horizon = kShardEnd;
+    for (std::size_t k = 0; k < ahead_.size(); ++k) {
+      if (more_[k]) horizon = std::min(horizon, ahead_[k].back());
+    }
+    window_.clear();
+    for (auto const& a : ahead_) {
+      for (const auto t : a) {
+        if (t <= horizon) window_.push_back(t);
+      }
+    }
+    std::sort(window_.begin(), window_.end());
+    window_.erase(std::unique(window_.begin(), window_.end()), window_.end());
+    if (window_.size() > window_cap_) window_.resize(window_cap_);
+  }
+
+  bool send_go(std::size_t k) {
+    remote_of(k);
+    shard::begin(out_, shard::Msg::Go);
+    q::ser::Writer w(out_);
+    w.put_vec(window_);
+    shard::put(w, remote_);
+    return shard::send_msg(fds_[k], out_) || fail("lost shard " + std::to_string(k));
+  }
+
+  // 收分片 k 在 window_ 之后的报告：每轮 equity 计入 round_eq_，更新它接下来的 ts 与汇总
+  // （总和按差量更新，int64 => 与归约顺序无关）
+  bool read_report(std::size_t k) {
+    shard::Msg t{};
+    if (!shard::recv_msg(fds_[k], t, in_) || t != shard::Msg::Report) return fail("lost shard " + std::to_string(k));
+    q::ser::Reader r(in_);
+    auto& ahead = ahead_[k];
+    r.get_vec(ahead);
+    more_[k] = r.get<bool>();
+    r.get_vec(eq_);
+    shard::get(r, tmp_);
+    if (!r.ok() || eq_.size() != window_.size()) return fail("bad report from shard " + std::to_string(k));
+    if (more_[k] && ahead.empty()) return fail("shard " + std::to_string(k) + " reported no upcoming ts");
+    const std::int64_t last = window_.empty() ? std::numeric_limits<std::int64_t>::min() : window_.back();
+    for (std::size_t i = 0; i < ahead.size(); ++i) {
+      if (ahead[i] <= (i == 0 ? last : ahead[i - 1])) return fail("shard " + std::to_string(k) + " went back in time");
+    }
+    for (std::size_t i = 0; i < eq_.size(); ++i) round_eq_[i] += eq_[i];
+
+    auto& a = agg_[k];
+    total_.equity += tmp_.equity - a.equity;
+    total_.gross += tmp_.gross - a.gross;
+    total_.net += tmp_.net - a.net;
+    if (total_.group_gross.size() < tmp_.group_gross.size()) total_.group_gross.resize(tmp_.group_gross.size(), 0);
+    for (std::size_t g = 0; g < a.group_gross.size(); ++g) total_.group_gross[g] -= a.group_gross[g];
+    for (std::size_t g = 0; g < tmp_.group_gross.size(); ++g) total_.group_gross[g] += tmp_.group_gross[g];
+    if (tmp_.killed && !a.killed) ++n_killed_;
+    total_.killed = n_killed_ > 0;
+    std::swap(a, tmp_);
+    return true;
+  }
+
+  // 分片 k 之外的汇总 -> remote_
+  void remote_of(std::size_t k) {
+    const auto& a = agg_[k];
+    remote_.equity = total_.equity - a.equity;
+    remote_.gross = total_.gross - a.gross;
+    remote_.net = total_.net - a.net;
+    remote_.killed = total_.killed;
+    remote_.group_gross.assign(total_.group_gross.begin(), total_.group_gross.end());
+    for (std::size_t g = 0; g < a.group_gross.size(); ++g) remote_.group_gross[g] -= a.group_gross[g];
+  }
+
+  std::vector<int> fds_;
+  std::vector<std::uint64_t> n_syms_;
+  std::uint32_t window_cap_;
+  std::vector<PortfolioAggregates> agg_;
+  std::vector<std::vector<std::int64_t>> ahead_; // 各分片报告的接下来的 ts
+  std::vector<bool> more_;                       // 各分片在 ahead_ 之外是否还有数据
+  std::vector<std::int64_t> window_;             // 当前一段的全局 ts
+  std::vector<std::int64_t> round_eq_;           // 当前一段每轮的全局 equity
+  std::vector<std::int64_t> eq_;
+  PortfolioAggregates total_;
+  PortfolioAggregates remote_;
+  PortfolioAggregates tmp_;
+  std::size_t n_killed_{0};
+  std::vector<ShardResult> results_;
+  Stats stats_{};
+  std::string error_;
+  std::string in_;
+  std::string out_;
+};
+
+} // namespace bt3
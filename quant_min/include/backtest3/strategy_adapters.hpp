@@ -0,0 +1,69 @@
+#pragma once
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "common/serialize.hpp"
+#include "backtest3/multi_market_view.hpp"
+#include "backtest3/strategy_api.hpp"
+#include "backtest3/strategy_pairs.hpp"
+#include "backtest3/strategy_portfolio.hpp"
+
+namespace bt3 {
+
+// 把逐笔回调的老接口包成 BatchedPortfolioStrategy（持有被包的策略，按值）
+// 支持的老接口：
+// - on_order_updated(sym, oms, up)（可选）
+// - on_batch(const MarketSnapshot&, const Portfolio&) -> PortfolioDecision
+// - on_batch(const MultiMarketView&, const Portfolio&) -> std::vector<OrderIntent>（只下单不撤单）
+// 回报循环在这里、对引擎是一次调用；被包的策略照旧每 batch 看全部 symbol，不利用 changed
+template <class Legacy>
+class BatchedStrategyAdapter {
+public:
+  template <class... Args>
+  explicit BatchedStrategyAdapter(Args&&... args) : s_(std::forward<Args>(args)...) {}
+
+  Legacy& inner() { return s_; }
+  const Legacy& inner() const { return s_; }
+
+  void on_order_updates(std::span<const OrderUpdateRef> ups) {
+    if constexpr (requires(const OrderUpdateRef& u) { s_.on_order_updated(u.sym_idx, *u.oms, *u.up); }) {
+      for (auto const& u : ups) s_.on_order_updated(u.sym_idx, *u.oms, *u.up);
+    } else {
+      (void)ups;
+    }
+  }
+
+  PortfolioDecision on_batch(const StrategyBatch& b) {
+    if constexpr (requires { { s_.on_batch(b.snap, b.pf) } -> std::same_as<PortfolioDecision>; }) {
+      return s_.on_batch(b.snap, b.pf);
+    } else {
+      PortfolioDecision dec;
+      dec.submits = s_.on_batch(MultiMarketView{b.ts_ns, &b.snap}, b.pf);
+      return dec;
+    }
+  }
+
+  // checkpoint hook 透传
+  void save(q::ser::Writer& w) const
+    requires requires(const Legacy& s, q::ser::Writer& sw) { s.save(sw); }
+  {
+    s_.save(w);
+  }
+  void load(q::ser::Reader& r)
+    requires requires(Legacy& s, q::ser::Reader& sr) { s.load(sr); }
+  {
+    s_.load(r);
+  }
+
+private:
+  Legacy s_;
+};
+
+using MeanReversionBatched = BatchedStrategyAdapter<MeanReversionPortfolioStrategy>;
+using PairsMeanReversionBatched = BatchedStrategyAdapter<PairsMeanReversionStrategy>;
+
+static_assert(BatchedPortfolioStrategy<MeanReversionBatched>);
+static_assert(BatchedPortfolioStrategy<PairsMeanReversionBatched>);
+
+} // namespace bt3
@@ -0,0 +1,41 @@
+#pragma once
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "backtest/oms.hpp"                 // bt::Oms
+#include "backtest/orders.hpp"              // bt::OrderUpdate
+#include "backtest3/market_snapshot.hpp"
+#include "backtest3/portfolio.hpp"
+#include "backtest3/strategy_portfolio.hpp" // PortfolioDecision
+
+namespace bt3 {
+
+// MultiSymbolEngine 的策略接口（编译期分派，无虚函数）：每次 merge 一次回调、每 batch 一次决策
+// - 回报按 (sym 升序, sym 内产生顺序) 排好，一次以 span 交给策略，引擎里没有 per-update 调用
+// - 指针指向引擎的 per-symbol 缓冲，只在回调期间有效
+struct OrderUpdateRef {
+  std::size_t sym_idx{};
+  const bt::Oms* oms{nullptr};
+  const bt::OrderUpdate* up{nullptr};
+};
+
+// barrier 后的一个 batch：snap 是全部 symbol 的列式视图，changed 是本 batch 视图有变化的 symbol（升序）
+// 只关心变化的策略遍历 changed 即可；要每 batch 全量采样的策略照旧按列扫 snap
+// remote：分片运行时其余分片在上一个全局 ts 结束时的组合汇总（跨分片信号用）；单进程为 nullptr
+struct StrategyBatch {
+  std::int64_t ts_ns{};
+  const MarketSnapshot& snap;
+  std::span<const std::size_t> changed;
+  const Portfolio& pf;
+  const PortfolioAggregates* remote{nullptr};
+};
+
+template <class S>
+concept BatchedPortfolioStrategy = requires(S& s, std::span<const OrderUpdateRef> ups, const StrategyBatch& b) {
+  s.on_order_updates(ups);
+  { s.on_batch(b) } -> std::same_as<PortfolioDecision>;
+};
+
+} // namespace bt3
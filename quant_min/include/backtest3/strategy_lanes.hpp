@@ -0,0 +1,183 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "common/rolling_stats.hpp"
+#include "backtest/market_view.hpp"
+#include "backtest/orders.hpp"
+#include "backtest3/market_snapshot.hpp"
+#include "backtest3/portfolio.hpp"
+#include "backtest3/strategy_portfolio.hpp" // MeanRevPortfolioConfig / PortfolioDecision
+
+namespace bt3 {
+
+// K 组 MeanRevPortfolioConfig 一起算（参数 sweep 用），每组叫一个 lane：
+// - 所有 lane 看到同一份 mid 序列：每个不同的 window、每个 symbol 一个 q::RollingStats（[window][sym]），
+//   每 batch 每 symbol O(#windows) 更新，window 相同的 lane 共用
+// - 阈值比较按 lane 维连续数组一遍做完（无分支，编译器向量化）；之后只对有动作的 lane 走标量逻辑
+// - 挂单 id / 报价时间按 (sym, lane) 各自维护，持仓来自各 lane 自己的 Portfolio
+// - 每个 lane 的决策与单独跑 MeanReversionPortfolioStrategy(cfg_k) 逐笔一致（同一个 RollingStats 均值）
+class MeanReversionLanesStrategy {
+public:
+  MeanReversionLanesStrategy(std::size_t n_syms, std::vector<MeanRevPortfolioConfig> cfgs)
+      : n_(n_syms), k_(cfgs.size()), cfgs_(std::move(cfgs)) {
+    for (auto const& c : cfgs_) {
+      if (std::find(windows_.begin(), windows_.end(), c.window) == windows_.end()) windows_.push_back(c.window);
+    }
+
+    lane_win_.resize(k_);
+    lo_f_.resize(k_);
+    hi_f_.resize(k_);
+    for (std::size_t k = 0; k < k_; ++k) {
+      const auto& c = cfgs_[k];
+      const auto it = std::find(windows_.begin(), windows_.end(), c.window);
+      lane_win_[k] = static_cast<std::uint32_t>(it - windows_.begin());
+      lo_f_[k] = 1.0 - c.threshold;
+      hi_f_[k] = 1.0 + c.threshold;
+    }
+
+    roll_.reserve(windows_.size() * n_);
+    for (auto w : windows_) {
+      for (std::size_t i = 0; i < n_; ++i) roll_.emplace_back(w);
+    }
+    win_ma_.assign(windows_.size(), 0.0);
+    win_ready_.assign(windows_.size(), 0);
+    sig_.assign(k_, 0);
+
+    working_buy_.assign(n_ * k_, 0);
+    working_sell_.assign(n_ * k_, 0);
+    last_quote_ts_.assign(n_ * k_, 0);
+  }
+
+  std::size_t lanes() const { return k_; }
+  const MeanRevPortfolioConfig& config(std::size_t lane) const { return cfgs_[lane]; }
+
+  void on_order_updated(std::size_t lane, std::size_t sym_idx, const bt::OrderUpdate& up) {
+    switch (up.status) {
+      case bt::OrderStatus::Canceled:
+      case bt::OrderStatus::Rejected:
+      case bt::OrderStatus::Filled: {
+        const auto s = slot(sym_idx, lane);
+        if (working_buy_[s] == up.order_id) working_buy_[s] = 0;
+        if (working_sell_[s] == up.order_id) working_sell_[s] = 0;
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  // out[k] = lane k 的决策（复用调用方的 vector，清空后填充）；pfs[k] = lane k 的组合
+  void on_batch(const MarketSnapshot& snap,
+                const std::vector<Portfolio>& pfs,
+                std::vector<PortfolioDecision>& out) {
+    out.resize(k_);
+    for (auto& d : out) {
+      d.cancels.clear();
+      d.submits.clear();
+    }
+
+    const std::int64_t* bid = snap.bid();
+    const std::int64_t* ask = snap.ask();
+    for (std::size_t i = 0; i < snap.size(); ++i) {
+      if (bid[i] <= 0 || ask[i] <= 0) continue;
+      const auto mv = snap.view(i);
+
+      if (!push_mid(i, mv.mid_px)) continue; // 没有任何 window 就绪
+
+      // 1) 所有 lane 的阈值比较：bit0 = 低于 lower，bit1 = 高于 upper，bit2 = window 就绪
+      const double mid = static_cast<double>(mv.mid_px);
+      const double* win_ma = win_ma_.data();
+      const std::uint8_t* win_ready = win_ready_.data();
+      for (std::size_t k = 0; k < k_; ++k) {
+        const auto w = lane_win_[k];
+        const double ma = win_ma[w];
+        sig_[k] = static_cast<std::uint8_t>((mid < ma * lo_f_[k] ? 1u : 0u) |
+                                            (mid > ma * hi_f_[k] ? 2u : 0u) |
+                                            (win_ready[w] ? 4u : 0u));
+      }
+
+      // 2) 逐 lane：reprice / 下单（与单实例的 on_batch 同序）
+      for (std::size_t k = 0; k < k_; ++k) {
+        if (!(sig_[k] & 4u)) continue;
+        const auto& c = cfgs_[k];
+        const auto s = slot(i, k);
+        auto& dec = out[k];
+
+        if (c.reprice_after_ns > 0) {
+          auto& lq = last_quote_ts_[s];
+          if (lq > 0 && (mv.ts_ns - lq) >= c.reprice_after_ns) {
+            if (working_buy_[s] != 0) dec.cancels.push_back(CancelIntent{i, working_buy_[s]});
+            if (working_sell_[s] != 0) dec.cancels.push_back(CancelIntent{i, working_sell_[s]});
+            lq = mv.ts_ns;
+          }
+        }
+
+        const std::int64_t pos = pfs[k].pos(i);
+        if (pos == 0 && (sig_[k] & 1u) && (!c.one_order_per_side || working_buy_[s] == 0)) {
+          bt::OrderRequest req;
+          req.type = bt::OrderType::Limit;
+          req.side = bt::Side::Buy;
+          req.qty = c.trade_qty;
+          req.limit_px = mv.best_bid_px; // maker buy
+          dec.submits.push_back(OrderIntent{i, req});
+          last_quote_ts_[s] = mv.ts_ns;
+        }
+        if (pos > 0 && (sig_[k] & 2u) && (!c.one_order_per_side || working_sell_[s] == 0)) {
+          bt::OrderRequest req;
+          req.type = bt::OrderType::Limit;
+          req.side = bt::Side::Sell;
+          req.qty = pos; // 全平
+          req.limit_px = mv.best_ask_px; // maker sell
+          dec.submits.push_back(OrderIntent{i, req});
+          last_quote_ts_[s] = mv.ts_ns;
+        }
+      }
+    }
+  }
+
+private:
+  std::size_t slot(std::size_t sym_idx, std::size_t lane) const { return sym_idx * k_ + lane; }
+
+  // 推入一个 mid，更新各 window 的均值；返回是否有 window 就绪
+  bool push_mid(std::size_t i, std::int64_t mid) {
+    bool any = false;
+    for (std::size_t d = 0; d < windows_.size(); ++d) {
+      auto& r = roll_[d * n_ + i];
+      r.push(mid);
+      const bool ready = r.full();
+      win_ready_[d] = ready ? 1 : 0;
+      if (ready) {
+        win_ma_[d] = r.mean();
+        any = true;
+      }
+    }
+    return any;
+  }
+
+  std::size_t n_;
+  std::size_t k_;
+  std::vector<MeanRevPortfolioConfig> cfgs_;
+
+  // ---- 共享的 mid 历史 ----
+  std::vector<std::size_t> windows_;                 // 去重后的 window
+  std::vector<q::RollingStats<std::int64_t>> roll_;  // [window][sym]
+  std::vector<double> win_ma_;                       // 当前 symbol 各 window 的均值
+  std::vector<std::uint8_t> win_ready_;
+
+  // ---- lane 参数（SoA）----
+  std::vector<std::uint32_t> lane_win_; // lane -> windows_ 下标
+  std::vector<double> lo_f_;            // 1 - threshold
+  std::vector<double> hi_f_;            // 1 + threshold
+  std::vector<std::uint8_t> sig_;       // 当前 symbol 每个 lane 的信号位
+
+  // ---- (sym, lane) 状态 ----
+  std::vector<std::int64_t> working_buy_;
+  std::vector<std::int64_t> working_sell_;
+  std::vector<std::int64_t> last_quote_ts_;
+};
+
+} // namespace bt3
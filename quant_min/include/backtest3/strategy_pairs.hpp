@@ -1,12 +1,14 @@
 #pragma once
 #include <cstdint>
-#include <deque>
+#include <cstdlib>
 #include <vector>
 #include <cmath>
 
+#include "common/rolling_stats.hpp"
+#include "backtest/orders.hpp"
 #include "backtest3/multi_market_view.hpp"
-#include "backtest3/orders.hpp"
 #include "backtest3/portfolio.hpp"
+#include "backtest3/strategy_portfolio.hpp" // OrderIntent
 
 namespace bt3 {
 
@@ -21,20 +23,21 @@ struct PairsConfig {
 
 class PairsMeanReversionStrategy {
 public:
-  explicit PairsMeanReversionStrategy(PairsConfig cfg) : cfg_(cfg) {}
+  explicit PairsMeanReversionStrategy(PairsConfig cfg) : cfg_(cfg), spreads_(cfg.window) {}
 
-  std::vector<OrderIntent> on_batch(const MultiMarketView& mmv, const Portfolio& pf, SymbolId sym_a, SymbolId sym_b) {
+  // 下单价用 mid（限价单）；sym 即 engine 的 sym_idx（idx_a / idx_b）
+  std::vector<OrderIntent> on_batch(const MultiMarketView& mmv, const Portfolio& pf) {
     std::vector<OrderIntent> out;
-    const auto& a = mmv.mv(cfg_.idx_a);
-    const auto& b = mmv.mv(cfg_.idx_b);
+    const auto a = mmv.mv(cfg_.idx_a);
+    const auto b = mmv.mv(cfg_.idx_b);
     if (a.mid_px <= 0 || b.mid_px <= 0) return out;
 
     const double spread = static_cast<double>(a.mid_px - b.mid_px);
-    push(spread);
-    if (spreads_.size() < cfg_.window) return out;
+    spreads_.push(spread);
+    if (!spreads_.full()) return out;
 
-    const double mu = mean();
-    const double sd = stddev(mu);
+    const double mu = spreads_.mean();
+    const double sd = spreads_.stddev();
     if (sd <= 1e-9) return out;
 
     const double z = (spread - mu) / sd;
@@ -47,25 +50,21 @@ public:
     // 用 zscore 决定进入/退出
     if (std::fabs(z) < cfg_.exit_z) {
       // exit: flatten
-      if (pos_a != 0) {
-        out.push_back(OrderIntent{sym_a, pos_a > 0 ? Side::Sell : Side::Buy, std::llabs(pos_a), a.mid_px});
-      }
-      if (pos_b != 0) {
-        out.push_back(OrderIntent{sym_b, pos_b > 0 ? Side::Sell : Side::Buy, std::llabs(pos_b), b.mid_px});
-      }
+      if (pos_a != 0) out.push_back(intent(cfg_.idx_a, pos_a > 0 ? bt::Side::Sell : bt::Side::Buy, std::llabs(pos_a), a.mid_px));
+      if (pos_b != 0) out.push_back(intent(cfg_.idx_b, pos_b > 0 ? bt::Side::Sell : bt::Side::Buy, std::llabs(pos_b), b.mid_px));
       return out;
     }
 
     if (z > cfg_.entry_z) {
       // spread too high: short A, long B
       // target: pos_a = -qty, pos_b = +qty
-      out = rebalance_to(sym_a, sym_b, a, b, pos_a, pos_b, -cfg_.qty, +cfg_.qty);
+      out = rebalance_to(a, b, pos_a, pos_b, -cfg_.qty, +cfg_.qty);
       return out;
     }
 
     if (z < -cfg_.entry_z) {
       // spread too low: long A, short B
-      out = rebalance_to(sym_a, sym_b, a, b, pos_a, pos_b, +cfg_.qty, -cfg_.qty);
+      out = rebalance_to(a, b, pos_a, pos_b, +cfg_.qty, -cfg_.qty);
       return out;
     }
 
@@ -73,48 +72,31 @@ public:
   }
 
 private:
-  void push(double x) {
-    spreads_.push_back(x);
-    sum_ += x;
-    sumsq_ += x * x;
-    if (spreads_.size() > cfg_.window) {
-      double y = spreads_.front();
-      spreads_.pop_front();
-      sum_ -= y;
-      sumsq_ -= y * y;
-    }
-  }
-
-  double mean() const { return sum_ / static_cast<double>(spreads_.size()); }
-
-  double stddev(double mu) const {
-    double n = static_cast<double>(spreads_.size());
-    double var = (sumsq_ / n) - mu * mu;
-    return std::sqrt(std::max(0.0, var));
+  static OrderIntent intent(std::size_t sym_idx, bt::Side side, std::int64_t qty, std::int64_t px) {
+    OrderIntent oi;
+    oi.sym_idx = sym_idx;
+    oi.req.type = bt::OrderType::Limit;
+    oi.req.side = side;
+    oi.req.qty = qty;
+    oi.req.limit_px = px;
+    return oi;
   }
 
-  std::vector<OrderIntent> rebalance_to(SymbolId sym_a, SymbolId sym_b,
-                                        const MarketView& a, const MarketView& b,
+  std::vector<OrderIntent> rebalance_to(const MarketView& a, const MarketView& b,
                                         std::int64_t pos_a, std::int64_t pos_b,
                                         std::int64_t tgt_a, std::int64_t tgt_b) {
     std::vector<OrderIntent> out;
     const auto da = tgt_a - pos_a;
     const auto db = tgt_b - pos_b;
 
-    if (da != 0) {
-      out.push_back(OrderIntent{sym_a, da > 0 ? Side::Buy : Side::Sell, std::llabs(da), a.mid_px});
-    }
-    if (db != 0) {
-      out.push_back(OrderIntent{sym_b, db > 0 ? Side::Buy : Side::Sell, std::llabs(db), b.mid_px});
-    }
+    if (da != 0) out.push_back(intent(cfg_.idx_a, da > 0 ? bt::Side::Buy : bt::Side::Sell, std::llabs(da), a.mid_px));
+    if (db != 0) out.push_back(intent(cfg_.idx_b, db > 0 ? bt::Side::Buy : bt::Side::Sell, std::llabs(db), b.mid_px));
     return out;
   }
 
 private:
   PairsConfig cfg_;
-  std::deque<double> spreads_;
-  double sum_{0.0};
-  double sumsq_{0.0};
+  q::RollingStats<double> spreads_;
 };
 
 } // namespace bt3
@@ -1,13 +1,15 @@
 #pragma once
 #include <cstdint>
-#include <deque>
 #include <optional>
 #include <vector>
 
+#include "common/rolling_stats.hpp"   // q::RollingStats
+#include "common/serialize.hpp"       // checkpoint hook
 #include "backtest/market_view.hpp"   // MarketView
 #include "backtest/orders.hpp"      // bt::OrderRequest / Side / OrderStatus
 #include "backtest/oms.hpp"         // bt::Oms
 #include "backtest3/portfolio.hpp"  // bt3::Portfolio
+#include "backtest3/market_snapshot.hpp"
 
 namespace bt3 {
 
@@ -26,10 +28,9 @@ struct PortfolioDecision {
   std::vector<OrderIntent> submits;
 };
 
-// 每个品种一份状态：rolling mean + working order ids
+// 每个品种一份状态：rolling mean（容量 = window 的环形缓冲）+ working order ids
 struct PerSymState {
-  std::deque<std::int64_t> mids;
-  long double sum{0.0L};
+  q::RollingStats<std::int64_t> mids;
 
   std::int64_t working_buy_id{0};
   std::int64_t working_sell_id{0};
@@ -53,7 +54,9 @@ struct MeanRevPortfolioConfig {
 class MeanReversionPortfolioStrategy {
 public:
   MeanReversionPortfolioStrategy(std::size_t n_syms, MeanRevPortfolioConfig cfg)
-      : st_(n_syms), cfg_(cfg) {}
+      : st_(n_syms), cfg_(cfg) {
+    for (auto& s : st_) s.mids = q::RollingStats<std::int64_t>(cfg_.window);
+  }
 
   // barrier 后：引擎把 OMS 回报喂给策略
   void on_order_updated(std::size_t sym_idx, const bt::Oms& oms, const bt::OrderUpdate& up) {
@@ -87,21 +90,24 @@ public:
     else s.working_sell_id = ack.order_id;
   }
 
-  PortfolioDecision on_batch(const std::vector<MarketView>& mvs, const Portfolio& pf) {
+  // 每 batch 对每个有报价的 symbol 采样一次 mid（不只是本 batch 变化的），所以按列全扫
+  PortfolioDecision on_batch(const MarketSnapshot& snap, const Portfolio& pf) {
     PortfolioDecision dec;
     dec.cancels.reserve(64);
     dec.submits.reserve(64);
 
-    for (std::size_t i = 0; i < mvs.size(); ++i) {
-      const auto& mv = mvs[i];
-      if (mv.best_bid_px <= 0 || mv.best_ask_px <= 0) continue;
+    const std::int64_t* bid = snap.bid();
+    const std::int64_t* ask = snap.ask();
+    for (std::size_t i = 0; i < snap.size(); ++i) {
+      if (bid[i] <= 0 || ask[i] <= 0) continue;
+      const auto mv = snap.view(i);
 
       auto& s = st_[i];
-      push_mid(s, mv.mid_px);
+      s.mids.push(mv.mid_px);
 
-      if (s.mids.size() < cfg_.window) continue;
+      if (!s.mids.full()) continue;
 
-      const double ma = mean_mid(s);
+      const double ma = s.mids.mean();
       const double mid = static_cast<double>(mv.mid_px);
       const double upper = ma * (1.0 + cfg_.threshold);
       const double lower = ma * (1.0 - cfg_.threshold);
@@ -155,23 +161,31 @@ public:
     return dec;
   }
 
-private:
-  static void push_mid(PerSymState& s, std::int64_t mid) {
-    s.mids.push_back(mid);
-    s.sum += static_cast<long double>(mid);
-    if (s.mids.size() > 4000) { // 安全上限
-      s.sum -= static_cast<long double>(s.mids.front());
-      s.mids.pop_front();
+  // checkpoint hook：MultiSymbolEngine 检测到 save / load 才把策略状态写进 checkpoint
+  void save(q::ser::Writer& w) const {
+    w.put(static_cast<std::uint64_t>(st_.size()));
+    for (auto const& s : st_) {
+      s.mids.save(w);
+      w.put(s.working_buy_id);
+      w.put(s.working_sell_id);
+      w.put(s.last_quote_ts_ns);
     }
   }
 
-  double mean_mid(const PerSymState& s) const {
-    const auto n = std::min<std::size_t>(s.mids.size(), cfg_.window);
-    long double sum = 0.0L;
-    for (std::size_t k = s.mids.size() - n; k < s.mids.size(); ++k) sum += s.mids[k];
-    return static_cast<double>(sum / static_cast<long double>(n));
+  void load(q::ser::Reader& r) {
+    if (r.get<std::uint64_t>() != st_.size()) {
+      r.fail();
+      return;
+    }
+    for (auto& s : st_) {
+      s.mids.load(r);
+      r.get(s.working_buy_id);
+      r.get(s.working_sell_id);
+      r.get(s.last_quote_ts_ns);
+    }
   }
 
+private:
   bool can_place_buy(const PerSymState& s) const {
     if (!cfg_.one_order_per_side) return true;
     return s.working_buy_id == 0;
@@ -0,0 +1,182 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <iomanip>
+#include <ostream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "backtest3/engine.hpp"
+#include "backtest3/lane_engine.hpp"
+#include "backtest3/replay.hpp"
+#include "backtest3/scheduler.hpp"
+#include "backtest3/strategy_lanes.hpp"
+#include "backtest3/strategy_adapters.hpp"
+#include "backtest3/thread_pool.hpp"
+
+namespace bt3 {
+
+// 参数 sweep：事件流解码一次（SharedEvents，只读），K 组参数各起一个 engine 并发跑在 ThreadPool 上
+// - 每个 case 自己的 replay 游标 / scheduler / engine / strategy，只共享只读事件数据，无锁
+// - 并行度来自 case 之间：默认每个 engine 1 个 worker（主线程即 worker 0，不起线程）
+// - lanes_per_job > 1：相邻的若干 case 合成一组交给 LaneEngine + MeanReversionLanesStrategy，
+//   组内共享归并 / book 构建 / rolling mean，结果与独立 engine 逐笔一致
+// - 结果按 cases 的顺序返回，与完成顺序无关
+
+struct SweepCase {
+  MeanRevPortfolioConfig strat{};
+  bt::ExecConfig exec{};
+};
+
+struct SweepResult {
+  SweepCase c;
+  RunStats stats;
+};
+
+struct SweepConfig {
+  std::size_t n_jobs{0};            // 同时跑的 backtest 数；0 = hardware_concurrency
+  EngineConfig engine{.n_workers = 1}; // 每个 case 的 engine 配置（quiet 强制打开）
+  std::size_t lanes_per_job{1};     // 每个任务批量跑的 case 数；1 = 独立 engine，0 = ceil(cases / n_jobs)
+  bt::RiskConfig risk{};
+  PortfolioRiskConfig prisk{};
+};
+
+// 把任意 cursor 型 replay（例如 FileReplay）整段解码成共享的只读事件流
+template <class ReplayT>
+SharedEvents read_all_events(ReplayT& replay) {
+  std::vector<q::market::MarketEvent> v;
+  for (std::size_t idx = 0; replay.has_next(idx);) v.push_back(replay.next(idx));
+  return std::make_shared<const std::vector<q::market::MarketEvent>>(std::move(v));
+}
+
+inline RunStats run_sweep_case(const std::vector<SharedEvents>& data,
+                               const SweepCase& c,
+                               const EngineConfig& ec,
+                               const bt::RiskConfig& risk,
+                               const PortfolioRiskConfig& prisk) {
+  std::vector<VectorReplay> replays;
+  replays.reserve(data.size());
+  for (auto const& d : data) replays.emplace_back(d);
+  std::vector<VectorReplay*> rp;
+  rp.reserve(replays.size());
+  for (auto& r : replays) rp.push_back(&r);
+
+  SymBatchScheduler sched(rp, static_cast<std::int64_t>(rp.size()));
+  MultiSymbolEngine engine(data.size(), ec, c.exec, risk, prisk);
+  MeanReversionBatched strat(data.size(), c.strat);
+  return engine.run(sched, strat);
+}
+
+// 一组 case 共用一个 LaneEngine（单线程）；wall_s 为整组耗时
+inline std::vector<RunStats> run_sweep_lanes(const std::vector<SharedEvents>& data,
+                                             const SweepCase* cases,
+                                             std::size_t n_cases,
+                                             const EngineConfig& ec,
+                                             const PortfolioRiskConfig& prisk) {
+  std::vector<VectorReplay> replays;
+  replays.reserve(data.size());
+  for (auto const& d : data) replays.emplace_back(d);
+  std::vector<VectorReplay*> rp;
+  rp.reserve(replays.size());
+  for (auto& r : replays) rp.push_back(&r);
+
+  std::vector<bt::ExecConfig> exec;
+  std::vector<MeanRevPortfolioConfig> strat;
+  for (std::size_t k = 0; k < n_cases; ++k) {
+    exec.push_back(cases[k].exec);
+    strat.push_back(cases[k].strat);
+  }
+
+  SymBatchScheduler sched(rp, static_cast<std::int64_t>(rp.size()));
+  LaneEngine engine(data.size(), ec, exec, prisk);
+  MeanReversionLanesStrategy lanes(data.size(), std::move(strat));
+  return engine.run(sched, lanes);
+}
+
+inline std::vector<SweepResult> run_sweep(const std::vector<SharedEvents>& data,
+                                          const std::vector<SweepCase>& cases,
+                                          SweepConfig cfg = {}) {
+  std::vector<SweepResult> out;
+  if (cases.empty()) return out;
+
+  EngineConfig ec = cfg.engine;
+  ec.quiet = true;
+  std::size_t n_jobs = cfg.n_jobs;
+  if (n_jobs == 0) n_jobs = std::max(1u, std::thread::hardware_concurrency());
+
+  std::size_t lanes = cfg.lanes_per_job;
+  if (lanes == 0) lanes = (cases.size() + n_jobs - 1) / n_jobs;
+  if (lanes > 1) {
+    std::vector<std::future<std::vector<RunStats>>> groups;
+    ThreadPool pool(std::min(n_jobs, (cases.size() + lanes - 1) / lanes));
+    for (std::size_t b = 0; b < cases.size(); b += lanes) {
+      const auto cnt = std::min(lanes, cases.size() - b);
+      groups.push_back(pool.submit([&data, &cases, &ec, &cfg, b, cnt]() {
+        return run_sweep_lanes(data, cases.data() + b, cnt, ec, cfg.prisk);
+      }));
+    }
+    out.reserve(cases.size());
+    for (auto& g : groups) {
+      for (auto& rs : g.get()) out.push_back(SweepResult{cases[out.size()], rs});
+    }
+    return out;
+  }
+
+  std::vector<std::future<RunStats>> futs;
+  futs.reserve(cases.size());
+  {
+    ThreadPool pool(std::min(n_jobs, cases.size()));
+    for (auto const& c : cases) {
+      futs.push_back(pool.submit([&data, &c, &ec, &cfg]() {
+        return run_sweep_case(data, c, ec, cfg.risk, cfg.prisk);
+      }));
+    }
+    out.reserve(cases.size());
+    for (std::size_t k = 0; k < cases.size(); ++k) out.push_back(SweepResult{cases[k], futs[k].get()});
+  }
+  return out;
+}
+
+// 结果表：一行一个 case；pnl = 结束时 equity（起点 0，价格单位 * qty），max_dd 为逐 barrier 跟踪的峰值回撤
+// lane 模式下 wall_s 是所在组的耗时
+inline void print_sweep_table(std::ostream& os, const std::vector<SweepResult>& results) {
+  os << std::left
+     << std::setw(5) << "#"
+     << std::setw(8) << "window"
+     << std::setw(11) << "threshold"
+     << std::setw(6) << "qty"
+     << std::setw(12) << "reprice_ms"
+     << std::setw(12) << "cancel_ms"
+     << std::right
+     << std::setw(14) << "pnl"
+     << std::setw(14) << "max_dd"
+     << std::setw(9) << "fills"
+     << std::setw(10) << "rejects"
+     << std::setw(10) << "wall_s"
+     << "\n";
+  for (std::size_t k = 0; k < results.size(); ++k) {
+    const auto& c = results[k].c;
+    const auto& s = results[k].stats;
+    os << std::left
+       << std::setw(5) << k
+       << std::setw(8) << c.strat.window
+       << std::setw(11) << c.strat.threshold
+       << std::setw(6) << c.strat.trade_qty
+       << std::setw(12) << static_cast<double>(c.strat.reprice_after_ns) / 1e6
+       << std::setw(12) << static_cast<double>(c.exec.cancel_delay_base_ns) / 1e6
+       << std::right << std::fixed << std::setprecision(0)
+       << std::setw(14) << s.final_equity
+       << std::setw(14) << s.max_drawdown
+       << std::setw(9) << s.fills
+       << std::setw(10) << s.prisk_rejects
+       << std::setprecision(3)
+       << std::setw(10) << s.wall_s
+       << std::defaultfloat << std::setprecision(6)
+       << "\n";
+  }
+}
+
+} // namespace bt3
@@ -2,6 +2,8 @@
 #include <cstdint>
 #include <vector>
 
+#include "common/serialize.hpp"
+
 // ===================== 项目二（真实 OMS / Exec / Risk）=====================
 #include "backtest/orders.hpp"
 #include "backtest/oms.hpp"
@@ -18,7 +20,22 @@
 
 namespace bt3 {
 
-// 每个 SymbolContext 只由 owning worker 线程访问（OMS/Exec/Risk 线程绑定）
+// book.top() -> MarketView（你给的 top() 接口）；book 无效时只带 ts
+inline MarketView top_view(const q::book::FlatL2Book& book, std::int64_t ts_ns) {
+  MarketView mv{};
+  mv.ts_ns = ts_ns;
+
+  const auto t = book.top();
+  if (!t.valid) return mv;
+
+  mv.best_bid_px = t.bid_px;
+  mv.best_ask_px = t.ask_px;
+  mv.mid_px = (t.bid_px > 0 && t.ask_px > 0) ? ((t.bid_px + t.ask_px) / 2) : 0;
+  return mv;
+}
+
+// 每个 SymbolContext 同一时刻只由一个线程访问：owning worker，或工作量很小时的主线程
+// （engine 的 phase barrier 保证 happens-before，OMS/Exec/Risk 无需加锁）
 struct SymbolContext {
   // ---- market/book ----
   q::book::FlatL2Book book{};
@@ -40,22 +57,12 @@ struct SymbolContext {
   void set_exec_config(const bt::ExecConfig& cfg) { exec = bt::ExecutionSim(cfg); }
   void set_risk_config(const bt::RiskConfig& cfg) { risk = bt::RiskManager(cfg); }
 
-  // 从 book.top() 刷新 MarketView（你给的 top() 接口）
-  void refresh_view(std::int64_t ts_ns) {
-    last_mv.ts_ns = ts_ns;
+  // ---- pipelined 模式：book 先行建好，每个有效事件留一个视图，exec 稍后按序回放 ----
+  std::vector<MarketView> staged_views;
 
-    const auto t = book.top();
-    if (!t.valid) {
-      last_mv.best_bid_px = 0;
-      last_mv.best_ask_px = 0;
-      last_mv.mid_px = 0;
-      return;
-    }
+  MarketView view_at(std::int64_t ts_ns) const { return top_view(book, ts_ns); }
 
-    last_mv.best_bid_px = t.bid_px;
-    last_mv.best_ask_px = t.ask_px;
-    last_mv.mid_px = (t.bid_px > 0 && t.ask_px > 0) ? ((t.bid_px + t.ask_px) / 2) : 0;
-  }
+  void refresh_view(std::int64_t ts_ns) { last_mv = view_at(ts_ns); }
 
   // Market Phase：顺序处理该 symbol 在同 ts 的所有 market events
   void process_market_events(const std::vector<q::market::MarketEvent>& evs, std::int64_t ts_ns) {
@@ -67,17 +74,55 @@ struct SymbolContext {
       if (!builder.book_valid()) continue;
 
       refresh_view(ts_ns);
+      match_on_view();
+    }
+  }
+
+  // 拆开的 Market Phase（pipelined）：
+  // 1) prebuild 只推进 book/builder，把视图存进 staged_views —— 不碰 oms/exec/last_mv，
+  //    所以可以和上一 ts 的策略决策、Phase B 的输入准备并行
+  // 2) execute_staged 在下一轮 Phase A 回放这些视图撮合，结果与 process_market_events 逐事件一致
+  void prebuild_market_events(const std::vector<q::market::MarketEvent>& evs, std::int64_t ts_ns) {
+    staged_views.clear();
+    for (const auto& e : evs) {
+      builder.on_event(e);
+      if (!builder.book_valid()) continue;
+      staged_views.push_back(view_at(ts_ns));
+    }
+  }
 
-      // 真实撮合推进（partial fill / cancel effective / ttl 等都在项目二 exec 内）
-      auto fs = exec.on_market(oms, last_mv);
-      for (auto& f : fs) fills.push_back(f);
+  void execute_staged() {
+    fills.clear();
+    updates.clear();
 
-      // 异步回报（CancelAck / Filled / PartiallyFilled / Expired...）
-      auto ups = exec.drain_updates(); // 如果你项目二方法名不同，这里改一下
-      for (auto& u : ups) updates.push_back(std::move(u));
+    for (const auto& mv : staged_views) {
+      last_mv = mv;
+      match_on_view();
     }
   }
 
+  // checkpoint（batch 边界、worker 已 join）：book / builder / OMS / exec / risk / 视图；
+  // staged_views 是 pipelined 模式下已预建、待下一轮撮合的视图，也要带上。fills / updates 是 phase 内的临时输出，不存
+  void save(q::ser::Writer& w) const {
+    book.save(w);
+    builder.save(w);
+    oms.save(w);
+    exec.save(w);
+    risk.save(w);
+    w.put(last_mv);
+    w.put_vec(staged_views);
+  }
+
+  void load(q::ser::Reader& r) {
+    book.load(r);
+    builder.load(r);
+    oms.load(r);
+    exec.load(r);
+    risk.load(r);
+    r.get(last_mv);
+    r.get_vec(staged_views);
+  }
+
   // Order Phase：执行 cancel / submit（仍然只在 owning worker 线程触发）
   struct SubmitCmd { bt::OrderRequest req; };
   struct CancelCmd { std::int64_t order_id{}; };
@@ -103,6 +148,18 @@ struct SymbolContext {
       for (auto& u : ups) updates.push_back(std::move(u));
     }
   }
+
+private:
+  // 以 last_mv 推进撮合，收集 fills / 异步回报
+  void match_on_view() {
+    // 真实撮合推进（partial fill / cancel effective / ttl 等都在项目二 exec 内）
+    auto fs = exec.on_market(oms, last_mv);
+    for (auto& f : fs) fills.push_back(f);
+
+    // 异步回报（CancelAck / Filled / PartiallyFilled / Expired...）
+    auto ups = exec.drain_updates(); // 如果你项目二方法名不同，这里改一下
+    for (auto& u : ups) updates.push_back(std::move(u));
+  }
 };
 
 } // namespace bt3
@@ -1,88 +1,191 @@
 #pragma once
-#include <condition_variable>
+#include <atomic>
 #include <cstddef>
-#include <functional>
-#include <mutex>
+#include <cstdint>
+#include <memory>
+#include <string>
 #include <thread>
+#include <type_traits>
 #include <vector>
 
+#include "common/backoff.hpp"
+#include "common/trace.hpp"
+
 namespace bt3 {
 
+// barrier 式 worker pool：
+// - worker 0 就是调用线程（主线程），1..n-1 是后台线程 —— 每个 phase 少一次 handoff
+// - 分发/完成都走 per-worker 序号（start_seq / done_seq），无 mutex、无 std::function
+// - 等待策略：spin(pause) -> yield -> futex park（atomic::wait）；只有对方真的 park 了才 notify
+//   worker 数超过硬件线程时 spin 只会抢被等的那个线程的 CPU，默认跳过 spin 段
+// - job 以引用传入（模板 thunk），run_all 返回前 job 必须存活
 class WorkerPool {
 public:
-  explicit WorkerPool(std::size_t n_workers)
+  static constexpr std::uint32_t kAutoSpin = ~std::uint32_t{0};
+
+  explicit WorkerPool(std::size_t n_workers,
+                      std::uint32_t spin_iters = kAutoSpin,
+                      std::uint32_t yield_iters = 64)
       : n_(n_workers ? n_workers : 1),
-        jobs_(n_),
-        has_job_(n_, false),
-        stop_(false) {
-    threads_.reserve(n_);
-    for (std::size_t i = 0; i < n_; ++i) {
+        spin_iters_(spin_iters == kAutoSpin ? default_spin_iters(n_) : spin_iters),
+        yield_iters_(yield_iters),
+        slots_(std::make_unique<Slot[]>(n_)) {
+    pending_.reserve(n_);
+    threads_.reserve(n_ - 1);
+    for (std::size_t i = 1; i < n_; ++i) {
       threads_.emplace_back([this, i]() { loop(i); });
     }
   }
 
   ~WorkerPool() {
-    {
-      std::lock_guard<std::mutex> lk(mu_);
-      stop_ = true;
-    }
-    cv_.notify_all();
+    stop_.store(true, std::memory_order_relaxed);
+    ++epoch_;
+    for (std::size_t i = 1; i < n_; ++i) wake(slots_[i].start_seq, slots_[i].sleeping, epoch_);
     for (auto& t : threads_) if (t.joinable()) t.join();
   }
 
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
   std::size_t size() const { return n_; }
 
-  // 同步执行：对每个 worker 分发一个 job，然后等待全部完成（barrier）
-  void run_all(const std::vector<std::function<void(std::size_t)>>& per_worker_job) {
-    // per_worker_job.size() 必须 == n_
+  static std::uint32_t default_spin_iters(std::size_t n_workers) {
+    const std::size_t hw = std::thread::hardware_concurrency();
+    return (hw > 1 && n_workers <= hw) ? 4000u : 0u;
+  }
+
+  // 同步执行：每个 worker 调一次 job(wid)，然后等待全部完成（barrier）
+  template <class F>
+  void run_all(F&& job) {
+    publish(job);
+    for (std::size_t i = 1; i < n_; ++i) wake(slots_[i].start_seq, slots_[i].sleeping, epoch_);
     {
-      std::lock_guard<std::mutex> lk(mu_);
-      for (std::size_t i = 0; i < n_; ++i) {
-        jobs_[i] = per_worker_job[i];
-        has_job_[i] = true;
+      QM_TRACE_SCOPE("pool.job");
+      job(std::size_t{0});
+    }
+    QM_TRACE_SCOPE("pool.barrier_wait");
+    for (std::size_t i = 1; i < n_; ++i) wait_done(i);
+  }
+
+  // 只唤醒 wids 里的 worker（升序、不重复）；其余 worker 本轮保持 park，不付唤醒成本
+  // wid 0 在列表里时由调用线程执行
+  template <class F>
+  void run_on(const std::vector<std::size_t>& wids, F&& job) {
+    start_on(wids, job);
+    join();
+  }
+
+  // 异步版本：唤醒后台 worker 后立即返回，调用线程可以先做别的事（例如跑策略）
+  // join() 时调用线程补跑 wid 0 的那份（若在列表里），再等其余 worker 完成
+  // job 必须活到 join() 返回；start_on / join 必须成对，中间不能再分发
+  template <class F>
+  void start_on(const std::vector<std::size_t>& wids, F& job) {
+    pending_.clear();
+    pending_main_ = false;
+    if (wids.empty()) return;
+    publish(job);
+    for (auto wid : wids) {
+      if (wid == 0) {
+        pending_main_ = true;
+        continue;
       }
-      done_ = 0;
+      wake(slots_[wid].start_seq, slots_[wid].sleeping, epoch_);
+      pending_.push_back(wid);
     }
-    cv_.notify_all();
+  }
 
-    // wait barrier
-    std::unique_lock<std::mutex> lk(mu_);
-    cv_done_.wait(lk, [&]() { return done_ == n_; });
+  void join() {
+    if (pending_main_) {
+      QM_TRACE_SCOPE("pool.job");
+      job_fn_(job_ctx_, 0);
+    }
+    QM_TRACE_SCOPE("pool.barrier_wait");
+    for (auto wid : pending_) wait_done(wid);
+    pending_.clear();
+    pending_main_ = false;
   }
 
 private:
-  void loop(std::size_t wid) {
-    for (;;) {
-      std::function<void(std::size_t)> job;
-      {
-        std::unique_lock<std::mutex> lk(mu_);
-        cv_.wait(lk, [&]() { return stop_ || has_job_[wid]; });
-        if (stop_) return;
-        job = std::move(jobs_[wid]);
-        has_job_[wid] = false;
-      }
+  struct alignas(64) Slot {
+    std::atomic<std::uint64_t> start_seq{0}; // main -> worker
+    std::atomic<std::uint32_t> sleeping{0};  // worker parked on start_seq
+    alignas(64) std::atomic<std::uint64_t> done_seq{0}; // worker -> main
+    std::atomic<std::uint32_t> main_sleeping{0};        // main parked on done_seq
+  };
+
+  template <class F>
+  static void invoke(void* p, std::size_t wid) { (*static_cast<std::remove_reference_t<F>*>(p))(wid); }
+
+  template <class F>
+  void publish(F& job) {
+    job_ctx_ = const_cast<void*>(static_cast<const void*>(&job));
+    job_fn_ = &invoke<F>;
+    ++epoch_;
+  }
+
+  static void wake(std::atomic<std::uint64_t>& seq, std::atomic<std::uint32_t>& sleeping, std::uint64_t v) {
+    seq.store(v, std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_seq_cst)) seq.notify_all();
+  }
+
+  template <class Pred>
+  std::uint64_t await(std::atomic<std::uint64_t>& seq, std::atomic<std::uint32_t>& sleeping, Pred ready) const {
+    std::uint64_t v = seq.load(std::memory_order_acquire);
+    for (std::uint32_t i = 0; !ready(v) && i < spin_iters_; ++i) {
+      q::cpu_relax();
+      v = seq.load(std::memory_order_acquire);
+    }
+    for (std::uint32_t i = 0; !ready(v) && i < yield_iters_; ++i) {
+      std::this_thread::yield();
+      v = seq.load(std::memory_order_acquire);
+    }
+    while (!ready(v)) {
+      sleeping.store(1, std::memory_order_seq_cst);
+      v = seq.load(std::memory_order_seq_cst);
+      if (!ready(v)) seq.wait(v, std::memory_order_seq_cst);
+      sleeping.store(0, std::memory_order_relaxed);
+      v = seq.load(std::memory_order_acquire);
+    }
+    return v;
+  }
 
-      if (job) job(wid);
+  void wait_done(std::size_t wid) {
+    auto& s = slots_[wid];
+    const auto target = epoch_;
+    await(s.done_seq, s.main_sleeping, [target](std::uint64_t v) { return v == target; });
+  }
 
+  void loop(std::size_t wid) {
+    auto& s = slots_[wid];
+    std::uint64_t seen = 0;
+    QM_TRACE_THREAD_NAME(("worker " + std::to_string(wid)).c_str());
+    for (;;) {
+      seen = await(s.start_seq, s.sleeping, [seen](std::uint64_t v) { return v != seen; });
+      if (stop_.load(std::memory_order_relaxed)) return;
       {
-        std::lock_guard<std::mutex> lk(mu_);
-        ++done_;
-        if (done_ == n_) cv_done_.notify_one();
+        QM_TRACE_SCOPE("pool.job");
+        job_fn_(job_ctx_, wid);
       }
+      wake(s.done_seq, s.main_sleeping, seen);
     }
   }
 
 private:
   std::size_t n_;
+  std::uint32_t spin_iters_;
+  std::uint32_t yield_iters_;
+  std::unique_ptr<Slot[]> slots_;
   std::vector<std::thread> threads_;
 
-  std::mutex mu_;
-  std::condition_variable cv_;
-  std::condition_variable cv_done_;
-  bool stop_;
-  std::vector<std::function<void(std::size_t)>> jobs_;
-  std::vector<bool> has_job_;
-  std::size_t done_{0};
+  // 只由主线程写；worker 在 acquire 到 start_seq 之后读
+  void* job_ctx_{nullptr};
+  void (*job_fn_)(void*, std::size_t){nullptr};
+  std::uint64_t epoch_{0};
+  std::atomic<bool> stop_{false};
+
+  // start_on 之后、join 之前仍在跑的 worker
+  std::vector<std::size_t> pending_;
+  bool pending_main_{false};
 };
 
-} // namespace bt3
\ No newline at end of file
+} // namespace bt3
@@ -2,6 +2,7 @@
 #include <cstdint>
 #include <string>
 
+#include "common/serialize.hpp"
 #include "market/event.hpp"
 
 namespace q::book {
@@ -52,6 +53,18 @@ public:
   // 只有 Live 状态才认为 book 可用
   bool book_valid() const { return state_ == BuildState::Live; }
 
+  // checkpoint：只存 builder 自己的状态，book 由持有者另存
+  void save(q::ser::Writer& w) const {
+    w.put(state_);
+    w.put(stats_);
+    w.put(snapshot_seq_);
+  }
+  void load(q::ser::Reader& r) {
+    r.get(state_);
+    r.get(stats_);
+    r.get(snapshot_seq_);
+  }
+
 private:
   void on_snapshot_begin(const q::market::MarketEvent& e) {
     // 进入快照：清空 book
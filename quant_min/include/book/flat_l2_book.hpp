@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <vector>
 
+#include "common/serialize.hpp"
 #include "market/event.hpp"
 
 namespace q::book {
@@ -111,6 +112,16 @@ public:
     return out;
   }
 
+  // checkpoint：两侧价位原样存取
+  void save(q::ser::Writer& w) const {
+    w.put_vec(bids_);
+    w.put_vec(asks_);
+  }
+  void load(q::ser::Reader& r) {
+    r.get_vec(bids_);
+    r.get_vec(asks_);
+  }
+
 private:
   static std::vector<Level>::iterator lower_bound_price(std::vector<Level>& side, bool is_bid, std::int64_t price) {
     return std::lower_bound(
@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace q::alloc {
+
+// 全进程的 operator new 计数（所有线程）；只有某个 .cpp 展开了 QM_DEFINE_ALLOC_COUNTER 才会计数
+inline std::atomic<std::uint64_t> g_count{0};
+inline std::atomic<std::uint64_t> g_bytes{0};
+inline std::atomic<bool> g_installed{false};
+
+inline void on_alloc(std::size_t n) {
+  g_count.fetch_add(1, std::memory_order_relaxed);
+  g_bytes.fetch_add(n, std::memory_order_relaxed);
+}
+
+inline bool installed() { return g_installed.load(std::memory_order_relaxed); }
+inline std::uint64_t count() { return g_count.load(std::memory_order_relaxed); }
+inline std::uint64_t bytes() { return g_bytes.load(std::memory_order_relaxed); }
+
+} // namespace q::alloc
+
+// GCC 看得出 operator delete 里 free 的是 operator new 返回的指针，这里本来就是同一对 malloc / free
+#if defined(__GNUC__) && !defined(__clang__)
+#define QM_ALLOC_COUNTER_DIAG_PUSH_ _Pragma("GCC diagnostic push") _Pragma("GCC diagnostic ignored \"-Wmismatched-new-delete\"")
+#define QM_ALLOC_COUNTER_DIAG_POP_ _Pragma("GCC diagnostic pop")
+#else
+#define QM_ALLOC_COUNTER_DIAG_PUSH_
+#define QM_ALLOC_COUNTER_DIAG_POP_
+#endif
+
+// 在恰好一个 .cpp 的全局作用域展开：替换全局 operator new / delete（非对齐版本），转给 malloc / free
+// 对齐版本（alignas > __STDCPP_DEFAULT_NEW_ALIGNMENT__）仍走标准库实现，不计数
+#define QM_DEFINE_ALLOC_COUNTER                                                     \
+  QM_ALLOC_COUNTER_DIAG_PUSH_                                                       \
+  void* operator new(std::size_t n) {                                               \
+    ::q::alloc::on_alloc(n);                                                        \
+    if (void* p = std::malloc(n ? n : 1)) return p;                                 \
+    throw std::bad_alloc();                                                         \
+  }                                                                                 \
+  void* operator new[](std::size_t n) { return ::operator new(n); }                 \
+  void operator delete(void* p) noexcept { std::free(p); }                          \
+  void operator delete[](void* p) noexcept { std::free(p); }                        \
+  void operator delete(void* p, std::size_t) noexcept { std::free(p); }             \
+  void operator delete[](void* p, std::size_t) noexcept { std::free(p); }           \
+  static const bool qm_alloc_counter_installed_ = [] {                              \
+    ::q::alloc::g_installed.store(true, std::memory_order_relaxed);                 \
+    return true;                                                                    \
+  }();                                                                              \
+  QM_ALLOC_COUNTER_DIAG_POP_
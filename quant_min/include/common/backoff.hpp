@@ -5,6 +5,15 @@
 
 namespace q {
 
+// spin-wait 循环里的 CPU 提示（x86 pause / arm yield），降低空转功耗与超线程争用
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield" ::: "memory");
+#endif
+}
+
 // 在 SPSC ring consumer 实现自适应 idle backoff（spin/yield/sleep），在低负载时显著降低 CPU 占用，同时保持行情突发时低延迟恢复。
 class IdleBackoff {
 public:
@@ -0,0 +1,102 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace q {
+
+// 硬件计数器（perf_event_open）：cycles / instructions / LLC misses，一个 group 一次 read
+// - 只统计调用线程（pid = 0, cpu = -1），不含子线程
+// - 打不开（非 Linux、perf_event_paranoid、容器里没权限）时 ok() == false，read() 返回全 0
+struct PerfSample {
+  std::uint64_t cycles{0};
+  std::uint64_t instructions{0};
+  std::uint64_t llc_misses{0};
+
+  PerfSample& operator+=(const PerfSample& o) {
+    cycles += o.cycles;
+    instructions += o.instructions;
+    llc_misses += o.llc_misses;
+    return *this;
+  }
+  friend PerfSample operator-(const PerfSample& a, const PerfSample& b) {
+    return PerfSample{a.cycles - b.cycles, a.instructions - b.instructions, a.llc_misses - b.llc_misses};
+  }
+};
+
+class PerfCounters {
+public:
+  PerfCounters() = default;
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+  ~PerfCounters() { close_all(); }
+
+  // 打开并开始计数；返回是否成功
+  bool open() {
+#if defined(__linux__)
+    close_all();
+    static constexpr std::array<std::uint64_t, 3> kConfigs{
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES};
+    for (std::size_t k = 0; k < kConfigs.size(); ++k) {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.size = sizeof(attr);
+      attr.config = kConfigs[k];
+      attr.disabled = k == 0 ? 1 : 0;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP;
+      const int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, k == 0 ? -1 : fd_[0], 0UL));
+      if (fd < 0) {
+        close_all();
+        return false;
+      }
+      fd_[k] = fd;
+    }
+    ioctl(fd_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(fd_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  bool ok() const { return fd_[0] >= 0; }
+
+  // 自 open() 以来的累计值
+  PerfSample read() const {
+    PerfSample s;
+#if defined(__linux__)
+    if (!ok()) return s;
+    std::array<std::uint64_t, 4> buf{}; // nr + 3 个值
+    if (::read(fd_[0], buf.data(), sizeof(buf)) != static_cast<ssize_t>(sizeof(buf))) return s;
+    s.cycles = buf[1];
+    s.instructions = buf[2];
+    s.llc_misses = buf[3];
+#endif
+    return s;
+  }
+
+private:
+  void close_all() {
+#if defined(__linux__)
+    for (auto& fd : fd_) {
+      if (fd >= 0) ::close(fd);
+      fd = -1;
+    }
+#endif
+  }
+
+  std::array<int, 3> fd_{-1, -1, -1};
+};
+
+} // namespace q
@@ -0,0 +1,115 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "common/serialize.hpp"
+
+namespace q {
+
+// 固定容量滑动窗口统计：环形缓冲 + 增量 sum / sum of squares，push / mean / variance 都是 O(1)
+// - 窗口满之前统计的是已推入的全部样本；满了之后新样本挤掉最旧的
+// - 整数样本：sum 用 int64 精确累加（mean 与逐个求和的 long double 结果一致），平方和用 long double
+// - 浮点样本：long double 累加，每推入 window 个样本从缓冲区重算一次，抵消增删带来的舍入漂移
+// - variance 是总体方差（除以 n），与 E[x^2] - mean^2 同义，负的舍入误差截到 0
+template <class T>
+class RollingStats {
+  static_assert(std::is_arithmetic_v<T>, "RollingStats<T> requires an arithmetic T");
+
+public:
+  using Sum = std::conditional_t<std::is_integral_v<T>, std::int64_t, long double>;
+
+  explicit RollingStats(std::size_t window = 0) : buf_(window) {}
+
+  std::size_t window() const { return buf_.size(); }
+  std::size_t size() const { return n_; }
+  bool full() const { return n_ == buf_.size(); }
+  bool empty() const { return n_ == 0; }
+
+  void push(T x) {
+    if (buf_.empty()) return;
+    if (full()) {
+      const T old = buf_[head_];
+      sum_ -= static_cast<Sum>(old);
+      sumsq_ -= sq(old);
+    } else {
+      ++n_;
+    }
+    buf_[head_] = x;
+    sum_ += static_cast<Sum>(x);
+    sumsq_ += sq(x);
+    if (++head_ == buf_.size()) {
+      head_ = 0;
+      if constexpr (!std::is_integral_v<T>) resum();
+    }
+  }
+
+  void clear() {
+    n_ = 0;
+    head_ = 0;
+    sum_ = 0;
+    sumsq_ = 0.0L;
+  }
+
+  // 最新 / 最旧的样本（非空时有效）
+  T back() const { return buf_[(head_ + buf_.size() - 1) % buf_.size()]; }
+  T front() const { return buf_[(head_ + buf_.size() - n_) % buf_.size()]; }
+
+  Sum sum() const { return sum_; }
+
+  double mean() const {
+    return static_cast<double>(static_cast<long double>(sum_) / static_cast<long double>(n_));
+  }
+
+  double variance() const {
+    const long double n = static_cast<long double>(n_);
+    const long double mu = static_cast<long double>(sum_) / n;
+    const long double var = sumsq_ / n - mu * mu;
+    return var > 0.0L ? static_cast<double>(var) : 0.0;
+  }
+
+  double stddev() const { return std::sqrt(variance()); }
+
+  // checkpoint：缓冲区与累加器原样存取（浮点累加器不重算，resume 后逐位一致）
+  void save(q::ser::Writer& w) const {
+    w.put_vec(buf_);
+    w.put(n_);
+    w.put(head_);
+    w.put(sum_);
+    w.put(sumsq_);
+  }
+  void load(q::ser::Reader& r) {
+    r.get_vec(buf_);
+    r.get(n_);
+    r.get(head_);
+    r.get(sum_);
+    r.get(sumsq_);
+    if (n_ > buf_.size() || (head_ >= buf_.size() && !buf_.empty())) r.fail();
+  }
+
+private:
+  static long double sq(T x) {
+    const auto v = static_cast<long double>(x);
+    return v * v;
+  }
+
+  void resum() {
+    sum_ = 0;
+    sumsq_ = 0.0L;
+    for (std::size_t k = 0; k < n_; ++k) {
+      const T x = buf_[(head_ + buf_.size() - n_ + k) % buf_.size()];
+      sum_ += static_cast<Sum>(x);
+      sumsq_ += sq(x);
+    }
+  }
+
+  std::vector<T> buf_;
+  std::size_t n_{0};
+  std::size_t head_{0}; // 下一个写入位置
+  Sum sum_{0};
+  long double sumsq_{0.0L};
+};
+
+} // namespace q
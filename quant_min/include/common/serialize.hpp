@@ -0,0 +1,111 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace q::ser {
+
+// checkpoint 用的二进制序列化：原样 memcpy（小端、同一构建读写），不做跨版本 / 跨平台兼容
+// - Writer 追加到调用方的 std::string（复用 capacity，稳态不分配）
+// - Reader 越界时置 ok() == false 并停止读取，之后的 get 都返回零值
+class Writer {
+public:
+  explicit Writer(std::string& out) : out_(out) {}
+
+  template <class T>
+  void put(const T& v) {
+    static_assert(std::is_trivially_copyable_v<T>, "put<T> requires a trivially copyable T");
+    const auto n = out_.size();
+    out_.resize(n + sizeof(T));
+    std::memcpy(out_.data() + n, &v, sizeof(T));
+  }
+
+  void put_str(const std::string& s) {
+    put(static_cast<std::uint64_t>(s.size()));
+    out_.append(s);
+  }
+
+  template <class T>
+  void put_vec(const std::vector<T>& v) {
+    static_assert(std::is_trivially_copyable_v<T>, "put_vec<T> requires a trivially copyable T");
+    put(static_cast<std::uint64_t>(v.size()));
+    const auto n = out_.size();
+    out_.resize(n + v.size() * sizeof(T));
+    if (!v.empty()) std::memcpy(out_.data() + n, v.data(), v.size() * sizeof(T));
+  }
+
+  std::size_t size() const { return out_.size(); }
+
+private:
+  std::string& out_;
+};
+
+class Reader {
+public:
+  Reader(const char* p, std::size_t n) : p_(p), end_(p + n) {}
+  explicit Reader(const std::string& s) : Reader(s.data(), s.size()) {}
+
+  bool ok() const { return ok_; }
+  std::size_t remaining() const { return static_cast<std::size_t>(end_ - p_); }
+
+  template <class T>
+  void get(T& v) {
+    static_assert(std::is_trivially_copyable_v<T>, "get<T> requires a trivially copyable T");
+    if (!take(sizeof(T))) {
+      v = T{};
+      return;
+    }
+    std::memcpy(&v, p_ - sizeof(T), sizeof(T));
+  }
+
+  template <class T>
+  T get() {
+    T v{};
+    get(v);
+    return v;
+  }
+
+  void get_str(std::string& s) {
+    const auto n = get<std::uint64_t>();
+    if (!take(n)) {
+      s.clear();
+      return;
+    }
+    s.assign(p_ - n, n);
+  }
+
+  template <class T>
+  void get_vec(std::vector<T>& v) {
+    static_assert(std::is_trivially_copyable_v<T>, "get_vec<T> requires a trivially copyable T");
+    const auto n = get<std::uint64_t>();
+    if (n > remaining() / sizeof(T) || !take(n * sizeof(T))) {
+      ok_ = false;
+      v.clear();
+      return;
+    }
+    v.resize(n);
+    if (n) std::memcpy(v.data(), p_ - n * sizeof(T), n * sizeof(T));
+  }
+
+  // 内容与预期不符（magic / 版本 / 配置对不上）时由调用方置失败
+  void fail() { ok_ = false; }
+
+private:
+  bool take(std::size_t n) {
+    if (!ok_ || n > remaining()) {
+      ok_ = false;
+      return false;
+    }
+    p_ += n;
+    return true;
+  }
+
+  const char* p_;
+  const char* end_;
+  bool ok_{true};
+};
+
+} // namespace q::ser
@@ -0,0 +1,228 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+
+#include "common/clock.hpp"
+
+// 编译期开关：-DQM_TRACE=1 时 trace 点编进来（运行期再由 Tracer::enable 打开）；
+// 否则 QM_TRACE_* 宏展开为空，零开销
+#ifndef QM_TRACE
+#define QM_TRACE 0
+#endif
+
+namespace q::trace {
+
+// 一个区间事件；name 必须是静态字符串（只存指针）
+struct Event {
+  const char* name{nullptr};
+  std::uint64_t t0_ns{0};
+  std::uint64_t t1_ns{0};
+  std::uint64_t batch{0};
+};
+
+// 截断拷贝，总是以 '\0' 结尾
+template <std::size_t N>
+inline void copy_name(std::array<char, N>& dst, const char* src) {
+  const std::size_t n = std::min(std::strlen(src), N - 1);
+  std::memcpy(dst.data(), src, n);
+  dst[n] = '\0';
+}
+
+inline std::uint64_t now_ns() {
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<Ns>(q::now().time_since_epoch()).count());
+}
+
+// 每线程一个 ring：只有拥有它的线程写（无锁、无原子 RMW），满了覆盖最旧的
+// dump 要在写者都静止之后（例如 run() 返回、worker 已 park）
+class Ring {
+public:
+  Ring(std::uint32_t tid, std::size_t cap_pow2)
+      : tid_(tid), mask_(cap_pow2 - 1), buf_(std::make_unique<Event[]>(cap_pow2)) {}
+
+  void push(const Event& e) {
+    const auto h = head_.load(std::memory_order_relaxed);
+    buf_[h & mask_] = e;
+    head_.store(h + 1, std::memory_order_release);
+  }
+
+  std::uint32_t tid() const { return tid_; }
+  std::size_t capacity() const { return mask_ + 1; }
+  std::uint64_t head() const { return head_.load(std::memory_order_acquire); }
+  std::size_t size() const { return static_cast<std::size_t>(std::min<std::uint64_t>(head(), capacity())); }
+  std::uint64_t dropped() const { return head() - size(); }
+  // 按写入顺序，k ∈ [0, size())
+  const Event& at(std::size_t k) const { return buf_[(head() - size() + k) & mask_]; }
+
+  void set_name(const char* name) { copy_name(name_, name); }
+  const char* name() const { return name_.data(); }
+
+  void clear() { head_.store(0, std::memory_order_relaxed); }
+
+private:
+  std::uint32_t tid_;
+  std::size_t mask_;
+  std::unique_ptr<Event[]> buf_;
+  std::atomic<std::uint64_t> head_{0};
+  std::array<char, 32> name_{};
+};
+
+// 进程级 tracer：线程第一次记事件时注册自己的 ring（只在注册时有一次 fetch_add）
+class Tracer {
+public:
+  static constexpr std::size_t kMaxThreads = 256;
+
+  static Tracer& instance() {
+    static Tracer t;
+    return t;
+  }
+
+  ~Tracer() {
+    for (auto& r : rings_) delete r.load(std::memory_order_relaxed);
+  }
+
+  // ring_capacity 只对之后才注册的线程生效，向上取 2 的幂
+  void enable(bool on, std::size_t ring_capacity = std::size_t{1} << 16) {
+    ring_cap_ = std::bit_ceil(std::max<std::size_t>(ring_capacity, 2));
+    enabled_.store(on, std::memory_order_relaxed);
+  }
+  bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  // 事件的 batch 标签：由驱动循环的线程设置，worker 在被 barrier 唤醒后读到
+  void set_batch(std::uint64_t b) { batch_.store(b, std::memory_order_relaxed); }
+  std::uint64_t batch() const { return batch_.load(std::memory_order_relaxed); }
+
+  // 当前线程的 ring（第一次记事件时创建）；超过 kMaxThreads 时返回 nullptr（事件丢弃）
+  Ring* ring() {
+    auto& t = local();
+    if (t.ring || t.overflow) return t.ring;
+    const auto id = n_rings_.fetch_add(1, std::memory_order_relaxed);
+    if (id >= kMaxThreads) {
+      t.overflow = true;
+      return nullptr;
+    }
+    t.ring = new Ring(id, ring_cap_);
+    t.ring->set_name(t.name.data());
+    rings_[id].store(t.ring, std::memory_order_release);
+    return t.ring;
+  }
+
+  void record(const char* name, std::uint64_t t0, std::uint64_t t1) {
+    if (auto* r = ring()) r->push(Event{name, t0, t1, batch()});
+  }
+
+  // 只记下名字，不分配 ring（tracing 没打开的线程不占内存）
+  void set_thread_name(const char* name) {
+    auto& t = local();
+    copy_name(t.name, name);
+    if (t.ring) t.ring->set_name(name);
+  }
+
+  void clear() {
+    for_each_ring([](Ring& r) { r.clear(); });
+  }
+
+  std::size_t event_count() const {
+    std::size_t n = 0;
+    for_each_ring([&n](const Ring& r) { n += r.size(); });
+    return n;
+  }
+
+  // Chrome trace-event JSON（chrome://tracing / ui.perfetto.dev 都能打开）：
+  // 每个事件一个 "X"（complete）事件，ts / dur 单位 us，相对最早事件；tid = ring 编号
+  void write_chrome_json(std::ostream& os) const {
+    std::uint64_t base = ~std::uint64_t{0};
+    for_each_ring([&base](const Ring& r) {
+      for (std::size_t k = 0; k < r.size(); ++k) base = std::min(base, r.at(k).t0_ns);
+    });
+
+    auto us = [](std::uint64_t ns) { return static_cast<double>(ns) / 1e3; };
+    os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    bool first = true;
+    auto sep = [&os, &first]() {
+      if (!first) os << ",\n";
+      first = false;
+    };
+    for_each_ring([&](const Ring& r) {
+      sep();
+      os << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << r.tid()
+         << ",\"args\":{\"name\":\"" << (r.name()[0] ? r.name() : "thread") << "\"}}";
+      for (std::size_t k = 0; k < r.size(); ++k) {
+        const auto& e = r.at(k);
+        sep();
+        os << "{\"name\":\"" << e.name << "\",\"cat\":\"bt3\",\"ph\":\"X\",\"pid\":1,\"tid\":" << r.tid()
+           << ",\"ts\":" << us(e.t0_ns - base)
+           << ",\"dur\":" << us(e.t1_ns - e.t0_ns)
+           << ",\"args\":{\"batch\":" << e.batch << "}}";
+      }
+    });
+    os << "\n]}\n";
+  }
+
+private:
+  Tracer() {
+    for (auto& r : rings_) r.store(nullptr, std::memory_order_relaxed);
+  }
+
+  struct ThreadLocal {
+    Ring* ring{nullptr};
+    bool overflow{false};
+    std::array<char, 32> name{};
+  };
+  static ThreadLocal& local() {
+    thread_local ThreadLocal t;
+    return t;
+  }
+
+  template <class F>
+  void for_each_ring(F&& f) const {
+    const auto n = std::min<std::size_t>(n_rings_.load(std::memory_order_acquire), kMaxThreads);
+    for (std::size_t i = 0; i < n; ++i) {
+      if (auto* r = rings_[i].load(std::memory_order_acquire)) f(*r);
+    }
+  }
+
+  std::atomic<bool> enabled_{false};
+  std::atomic<std::uint64_t> batch_{0};
+  std::size_t ring_cap_{std::size_t{1} << 16};
+  std::atomic<std::uint32_t> n_rings_{0};
+  std::array<std::atomic<Ring*>, kMaxThreads> rings_;
+};
+
+// RAII 区间：构造时取 t0，析构时记一条事件；tracer 未 enable 时只有一次 relaxed load
+class Scope {
+public:
+  explicit Scope(const char* name)
+      : name_(name), t0_(Tracer::instance().enabled() ? now_ns() : 0) {}
+  ~Scope() {
+    if (t0_) Tracer::instance().record(name_, t0_, now_ns());
+  }
+  Scope(const Scope&) = delete;
+  Scope& operator=(const Scope&) = delete;
+
+private:
+  const char* name_;
+  std::uint64_t t0_;
+};
+
+} // namespace q::trace
+
+#if QM_TRACE
+#define QM_TRACE_CONCAT_(a, b) a##b
+#define QM_TRACE_CONCAT(a, b) QM_TRACE_CONCAT_(a, b)
+#define QM_TRACE_SCOPE(name) ::q::trace::Scope QM_TRACE_CONCAT(qm_trace_scope_, __LINE__){name}
+#define QM_TRACE_BATCH(b) ::q::trace::Tracer::instance().set_batch(b)
+#define QM_TRACE_THREAD_NAME(name) ::q::trace::Tracer::instance().set_thread_name(name)
+#else
+#define QM_TRACE_SCOPE(name) static_cast<void>(0)
+#define QM_TRACE_BATCH(b) static_cast<void>(0)
+#define QM_TRACE_THREAD_NAME(name) static_cast<void>(0)
+#endif
@@ -0,0 +1,240 @@
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+#include "common/csv.hpp"
+#include "market/event.hpp"
+
+namespace q::market {
+
+// ===================== CSV =====================
+// header: ts_ns,seq,kind,side,price,qty,action
+// kind: SB,SL,SE,I   side: B,A (SB/SE 可空)   action: N,C,D (只有 I)
+
+inline bool parse_i64(std::string_view s, std::int64_t& out) {
+  const char* b = s.data();
+  const char* e = s.data() + s.size();
+  auto [ptr, ec] = std::from_chars(b, e, out);
+  return ec == std::errc{} && ptr == e;
+}
+
+inline bool parse_kind(std::string_view s, Kind& out) {
+  if (s == "SB") { out = Kind::SnapshotBegin; return true; }
+  if (s == "SL") { out = Kind::SnapshotLevel; return true; }
+  if (s == "SE") { out = Kind::SnapshotEnd; return true; }
+  if (s == "I")  { out = Kind::Incremental; return true; }
+  return false;
+}
+
+inline bool parse_side(std::string_view s, Side& out) {
+  if (s.empty()) { out = Side::Unknown; return true; }
+  if (s == "B" || s == "Bid" || s == "bid") { out = Side::Bid; return true; }
+  if (s == "A" || s == "Ask" || s == "ask") { out = Side::Ask; return true; }
+  return false;
+}
+
+inline bool parse_action(std::string_view s, Action& out) {
+  if (s.empty()) { out = Action::None; return true; }
+  if (s == "N") { out = Action::New; return true; }
+  if (s == "C") { out = Action::Change; return true; }
+  if (s == "D") { out = Action::Delete; return true; }
+  return false;
+}
+
+// 一行 CSV -> MarketEvent；header / 格式不对返回 false
+inline bool parse_csv_event(std::string_view line, MarketEvent& e) {
+  const auto fields = q::split_csv_line(line);
+  if (fields.size() < 7) return false;
+
+  e = MarketEvent{};
+  if (!parse_i64(fields[0], e.ts_ns)) return false;
+  if (!parse_i64(fields[1], e.seq)) return false;
+  if (!parse_kind(fields[2], e.kind)) return false;
+  if (!parse_side(fields[3], e.side)) return false;
+
+  // price/qty can be empty for SB/SE
+  if (!fields[4].empty() && !parse_i64(fields[4], e.price)) return false;
+  if (!fields[5].empty() && !parse_i64(fields[5], e.qty)) return false;
+
+  return parse_action(fields[6], e.action);
+}
+
+inline constexpr char kCsvHeader[] = "ts_ns,seq,kind,side,price,qty,action\n";
+inline constexpr std::size_t kCsvLineMax = 128;
+
+// MarketEvent -> 一行 CSV（带 '\n'），parse_csv_event 的逆；SB/SE 的 side/price/qty 留空
+// out 至少 kCsvLineMax 字节，返回写入长度
+inline std::size_t format_csv_event(const MarketEvent& e, char* out) {
+  char* p = out;
+  char* const end = out + kCsvLineMax;
+  auto num = [&p, end](std::int64_t v) { p = std::to_chars(p, end, v).ptr; };
+  auto str = [&p](const char* s) { while (*s) *p++ = *s++; };
+
+  const bool level = e.kind == Kind::SnapshotLevel || e.kind == Kind::Incremental;
+  num(e.ts_ns);
+  *p++ = ',';
+  num(e.seq);
+  *p++ = ',';
+  str(e.kind == Kind::SnapshotBegin ? "SB" : e.kind == Kind::SnapshotLevel ? "SL" : e.kind == Kind::SnapshotEnd ? "SE" : "I");
+  *p++ = ',';
+  str(e.side == Side::Bid ? "B" : e.side == Side::Ask ? "A" : "");
+  *p++ = ',';
+  if (level) num(e.price);
+  *p++ = ',';
+  if (level) num(e.qty);
+  *p++ = ',';
+  str(e.action == Action::New ? "N" : e.action == Action::Change ? "C" : e.action == Action::Delete ? "D" : "");
+  *p++ = '\n';
+  return static_cast<std::size_t>(p - out);
+}
+
+// 顺序写 CSV（带 header），接口同 bin::EventWriter
+class CsvEventWriter {
+public:
+  explicit CsvEventWriter(const std::string& path, std::size_t buffer_bytes = std::size_t{1} << 20)
+      : ofs_(path, std::ios::binary | std::ios::trunc) {
+    buf_.resize(std::max(buffer_bytes, kCsvLineMax));
+    ofs_.write(kCsvHeader, static_cast<std::streamsize>(sizeof(kCsvHeader) - 1));
+  }
+
+  ~CsvEventWriter() { close(); }
+
+  CsvEventWriter(const CsvEventWriter&) = delete;
+  CsvEventWriter& operator=(const CsvEventWriter&) = delete;
+
+  bool good() const { return ofs_.good(); }
+  std::size_t written() const { return written_; }
+
+  void write(const MarketEvent& e) {
+    if (buf_.size() - n_ < kCsvLineMax) flush();
+    n_ += format_csv_event(e, buf_.data() + n_);
+    ++written_;
+  }
+
+  void close() {
+    if (!ofs_.is_open()) return;
+    flush();
+    ofs_.close();
+  }
+
+private:
+  void flush() {
+    if (n_ == 0) return;
+    ofs_.write(buf_.data(), static_cast<std::streamsize>(n_));
+    n_ = 0;
+  }
+
+  std::ofstream ofs_;
+  std::string buf_;
+  std::size_t n_{0};
+  std::size_t written_{0};
+};
+
+// ===================== binary =====================
+// 16B header（magic + version + record size）+ 定长 40B 记录，小端、无压缩
+// 定长记录 => 第 k 条事件的偏移可直接算出，按块 pread 不需要索引
+namespace bin {
+
+inline constexpr char kMagic[8] = {'Q', 'M', 'E', 'V', 'B', 'I', 'N', '1'};
+inline constexpr std::uint32_t kVersion = 1;
+inline constexpr std::size_t kHeaderBytes = 16;
+inline constexpr std::size_t kRecordBytes = 40;
+
+// ts(8) seq(8) price(8) qty(8) kind(1) side(1) action(1) pad(5)
+inline void encode(const MarketEvent& e, char* out) {
+  std::memcpy(out + 0, &e.ts_ns, 8);
+  std::memcpy(out + 8, &e.seq, 8);
+  std::memcpy(out + 16, &e.price, 8);
+  std::memcpy(out + 24, &e.qty, 8);
+  out[32] = static_cast<char>(e.kind);
+  out[33] = static_cast<char>(e.side);
+  out[34] = static_cast<char>(e.action);
+  std::memset(out + 35, 0, 5);
+}
+
+inline MarketEvent decode(const char* in) {
+  MarketEvent e{};
+  std::memcpy(&e.ts_ns, in + 0, 8);
+  std::memcpy(&e.seq, in + 8, 8);
+  std::memcpy(&e.price, in + 16, 8);
+  std::memcpy(&e.qty, in + 24, 8);
+  e.kind = static_cast<Kind>(in[32]);
+  e.side = static_cast<Side>(in[33]);
+  e.action = static_cast<Action>(in[34]);
+  return e;
+}
+
+inline void encode_header(char* out) {
+  std::memcpy(out, kMagic, 8);
+  const std::uint32_t rec = static_cast<std::uint32_t>(kRecordBytes);
+  std::memcpy(out + 8, &kVersion, 4);
+  std::memcpy(out + 12, &rec, 4);
+}
+
+inline bool valid_header(const char* in) {
+  std::uint32_t ver = 0, rec = 0;
+  std::memcpy(&ver, in + 8, 4);
+  std::memcpy(&rec, in + 12, 4);
+  return std::memcmp(in, kMagic, 8) == 0 && ver == kVersion && rec == kRecordBytes;
+}
+
+inline bool is_binary_file(const std::string& path) {
+  std::ifstream f(path, std::ios::binary);
+  char h[kHeaderBytes];
+  return f.read(h, static_cast<std::streamsize>(kHeaderBytes)) && valid_header(h);
+}
+
+// 顺序写：内部攒满一块再落盘
+class EventWriter {
+public:
+  explicit EventWriter(const std::string& path, std::size_t buffer_events = 4096)
+      : ofs_(path, std::ios::binary | std::ios::trunc), cap_(buffer_events ? buffer_events : 1) {
+    buf_.resize(cap_ * kRecordBytes);
+    char h[kHeaderBytes];
+    encode_header(h);
+    ofs_.write(h, static_cast<std::streamsize>(kHeaderBytes));
+  }
+
+  ~EventWriter() { close(); }
+
+  EventWriter(const EventWriter&) = delete;
+  EventWriter& operator=(const EventWriter&) = delete;
+
+  bool good() const { return ofs_.good(); }
+  std::size_t written() const { return written_; }
+
+  void write(const MarketEvent& e) {
+    encode(e, buf_.data() + n_ * kRecordBytes);
+    ++written_;
+    if (++n_ == cap_) flush();
+  }
+
+  void close() {
+    if (!ofs_.is_open()) return;
+    flush();
+    ofs_.close();
+  }
+
+private:
+  void flush() {
+    if (n_ == 0) return;
+    ofs_.write(buf_.data(), static_cast<std::streamsize>(n_ * kRecordBytes));
+    n_ = 0;
+  }
+
+  std::ofstream ofs_;
+  std::size_t cap_;
+  std::string buf_;
+  std::size_t n_{0};
+  std::size_t written_{0};
+};
+
+} // namespace bin
+
+} // namespace q::market
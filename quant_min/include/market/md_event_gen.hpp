@@ -0,0 +1,335 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "market/event.hpp"
+
+namespace q::market {
+
+// tools/gen_md_events.py 的 C++ 版：同一个模型、同一组参数（快照 + N/C/D 增量 + seq gap）
+// - 每行事件 ts += dt_ns；快照块 SB/SL/SE 共用一个 seq，之后 seq 连续递增
+// - 随机数是自带的 splitmix64（不依赖标准库分布的实现），同 seed 跨平台 / 跨编译器逐条一致
+//   与 Python 的 random 不是同一个序列：分布相同，具体事件不同
+struct MdGenConfig {
+  std::uint64_t seed{42};
+  std::int64_t events{1'000'000};    // 增量条数（不含快照行）
+  std::int64_t snapshot_every{20000}; // 每 N 条增量插一个快照块
+  std::size_t depth{200};            // 初始 / 快照每边档数
+  std::size_t max_depth_soft{400};   // 超过后 70% 概率改成删一档
+  std::int64_t base_mid{100'000};
+  std::int64_t tick_size{1};
+  std::int64_t spread_ticks{2};
+  std::int64_t qty_min{1};
+  std::int64_t qty_max{20};
+  std::int64_t start_ts{1'700'000'000'000'000'000};
+  std::int64_t dt_ns{1000};          // 每行 ts 步长
+  std::int64_t start_seq{100};
+
+  double p_new{0.10};
+  double p_change{0.80};
+  double p_delete{0.10};
+  double p_mid_move{0.02};           // 每条增量 mid 随机游走一步的概率
+
+  std::int64_t gap_every{0};         // >0：每 N 条增量在块前跳 gap_size 个 seq
+  std::int64_t gap_size{1};
+
+  // 多 symbol：symbol i 的 seed 由 (seed, i) 派生；mid / 起始 ts 可按 i 错开
+  std::int64_t mid_step{0};          // base_mid += i * mid_step
+  std::int64_t stagger_ns{0};        // start_ts += i * stagger_ns
+};
+
+// 参数不合法返回原因，合法返回 nullptr
+inline const char* validate(const MdGenConfig& c) {
+  if (c.events < 0) return "events must be >= 0";
+  if (c.snapshot_every <= 0) return "snapshot-every must be > 0";
+  if (c.depth == 0) return "depth must be > 0";
+  if (c.tick_size <= 0) return "tick-size must be > 0";
+  if (c.spread_ticks <= 0) return "spread-ticks must be > 0";
+  if (c.qty_min > c.qty_max) return "qty-min must be <= qty-max";
+  if (c.dt_ns < 0) return "dt-ns must be >= 0";
+  if (!(c.p_new >= 0.0 && c.p_change >= 0.0 && c.p_delete >= 0.0) || c.p_new + c.p_change + c.p_delete <= 0.0) {
+    return "p-new / p-change / p-delete must be >= 0 and sum to > 0";
+  }
+  return nullptr;
+}
+
+namespace md_gen {
+
+inline std::uint64_t splitmix64(std::uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+class Rng {
+public:
+  explicit Rng(std::uint64_t seed) : s_(seed) {}
+
+  std::uint64_t next() {
+    s_ += 0x9e3779b97f4a7c15ULL;
+    std::uint64_t z = s_;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  // [0, 1)
+  double uniform() { return static_cast<double>(next() >> 11) * 0x1.0p-53; }
+
+  // [0, n)，n > 0；n 远小于 2^64，取模偏差可忽略
+  std::size_t index(std::size_t n) { return static_cast<std::size_t>(next() % n); }
+
+  // [lo, hi]
+  std::int64_t range(std::int64_t lo, std::int64_t hi) {
+    const auto span = static_cast<std::uint64_t>(hi - lo) + 1;
+    return span == 0 ? static_cast<std::int64_t>(next()) : lo + static_cast<std::int64_t>(next() % span);
+  }
+
+private:
+  std::uint64_t s_;
+};
+
+// 一边的盘口：按 best -> worst 排好的 (px, qty) 平铺数组
+// 模型只在 worst 外侧加档、按下标随机取档 => push_back / 下标访问，删档是几百个 int64 的 memmove
+struct Ladder {
+  std::vector<std::int64_t> px;
+  std::vector<std::int64_t> qty;
+
+  std::size_t size() const { return px.size(); }
+  bool empty() const { return px.empty(); }
+  void clear() {
+    px.clear();
+    qty.clear();
+  }
+  void push_back(std::int64_t p, std::int64_t q) {
+    px.push_back(p);
+    qty.push_back(q);
+  }
+  void erase(std::size_t i) {
+    px.erase(px.begin() + static_cast<std::ptrdiff_t>(i));
+    qty.erase(qty.begin() + static_cast<std::ptrdiff_t>(i));
+  }
+};
+
+} // namespace md_gen
+
+// symbol i 的参数
+inline MdGenConfig symbol_config(const MdGenConfig& c, std::size_t sym) {
+  MdGenConfig out = c;
+  out.seed = md_gen::splitmix64(c.seed ^ md_gen::splitmix64(static_cast<std::uint64_t>(sym)));
+  out.base_mid = c.base_mid + static_cast<std::int64_t>(sym) * c.mid_step;
+  out.start_ts = c.start_ts + static_cast<std::int64_t>(sym) * c.stagger_ns;
+  return out;
+}
+
+// 单 symbol 生成器：run(sink) 按顺序对每一行调用 sink(const MarketEvent&)
+// sink 是模板参数（无 std::function），写文件 / 压 vector / 只计数都走同一条路径
+class MdEventGen {
+public:
+  explicit MdEventGen(const MdGenConfig& cfg) : cfg_(cfg), rng_(cfg.seed) {
+    const double total = cfg_.p_new + cfg_.p_change + cfg_.p_delete;
+    p_new_ = cfg_.p_new / total;
+    p_new_change_ = (cfg_.p_new + cfg_.p_change) / total;
+  }
+
+  // 行数上界（reserve 用）：增量 + 每个快照块 2 + 2 * depth
+  std::size_t max_events() const {
+    const auto inc = static_cast<std::size_t>(cfg_.events);
+    const auto every = static_cast<std::size_t>(cfg_.snapshot_every);
+    const std::size_t snaps = inc == 0 ? 1 : (inc + every - 1) / every;
+    return inc + snaps * (2 + 2 * cfg_.depth);
+  }
+
+  template <class Sink>
+  void run(Sink&& sink) {
+    ts_ = cfg_.start_ts;
+    seq_ = cfg_.start_seq;
+    mid_ = cfg_.base_mid;
+    init_book();
+
+    emit_snapshot(sink);
+    std::int64_t inc_emitted = 0;
+    while (inc_emitted < cfg_.events) {
+      const std::int64_t chunk = std::min(cfg_.snapshot_every, cfg_.events - inc_emitted);
+      if (cfg_.gap_every > 0 && inc_emitted > 0 && inc_emitted % cfg_.gap_every == 0) {
+        seq_ += std::max<std::int64_t>(1, cfg_.gap_size);
+      }
+      for (std::int64_t k = 0; k < chunk; ++k) emit_incremental(sink);
+      inc_emitted += chunk;
+      if (inc_emitted < cfg_.events) emit_snapshot(sink);
+    }
+  }
+
+private:
+  std::int64_t rand_qty() { return rng_.range(cfg_.qty_min, cfg_.qty_max); }
+
+  // 以 mid 为中心、固定 spread 的对称盘口
+  void init_book() {
+    const std::int64_t half = std::max<std::int64_t>(1, cfg_.spread_ticks / 2);
+    const std::int64_t best_bid = mid_ - half * cfg_.tick_size;
+    const std::int64_t best_ask = mid_ + half * cfg_.tick_size;
+    bids_.clear();
+    asks_.clear();
+    for (std::size_t i = 0; i < cfg_.depth; ++i) {
+      const auto off = static_cast<std::int64_t>(i) * cfg_.tick_size;
+      bids_.push_back(best_bid - off, rand_qty());
+      asks_.push_back(best_ask + off, rand_qty());
+    }
+  }
+
+  template <class Sink>
+  void emit(Sink& sink, Kind k, Side s, std::int64_t px, std::int64_t qty, Action a) {
+    sink(MarketEvent{ts_, seq_, k, s, px, qty, a});
+    ts_ += cfg_.dt_ns;
+  }
+
+  template <class Sink>
+  void emit_snapshot(Sink& sink) {
+    const std::int64_t snap_seq = seq_;
+    emit(sink, Kind::SnapshotBegin, Side::Unknown, 0, 0, Action::None);
+    const std::size_t nb = std::min(cfg_.depth, bids_.size());
+    for (std::size_t i = 0; i < nb; ++i) emit(sink, Kind::SnapshotLevel, Side::Bid, bids_.px[i], bids_.qty[i], Action::None);
+    const std::size_t na = std::min(cfg_.depth, asks_.size());
+    for (std::size_t i = 0; i < na; ++i) emit(sink, Kind::SnapshotLevel, Side::Ask, asks_.px[i], asks_.qty[i], Action::None);
+    emit(sink, Kind::SnapshotEnd, Side::Unknown, 0, 0, Action::None);
+    seq_ = snap_seq + 1;
+  }
+
+  // 非空的一边里随机挑一档
+  Side pick_existing(std::size_t& idx) {
+    Side s = Side::Bid;
+    if (bids_.empty()) s = Side::Ask;
+    else if (!asks_.empty()) s = rng_.index(2) == 0 ? Side::Bid : Side::Ask;
+    idx = rng_.index(side(s).size());
+    return s;
+  }
+
+  md_gen::Ladder& side(Side s) { return s == Side::Bid ? bids_ : asks_; }
+
+  template <class Sink>
+  void emit_incremental(Sink& sink) {
+    if (rng_.uniform() < cfg_.p_mid_move) {
+      mid_ += (static_cast<std::int64_t>(rng_.index(3)) - 1) * cfg_.tick_size;
+    }
+
+    Side s = Side::Bid;
+    std::size_t idx = 0;
+    std::int64_t qty = 0;
+    Action a = Action::Delete;
+    const double r = rng_.uniform();
+    if (r < p_new_) {
+      // 在 worst 外侧加一档（空的一边从 mid 旁边开始）
+      s = rng_.index(2) == 0 ? Side::Bid : Side::Ask;
+      qty = rand_qty();
+      a = Action::New;
+    } else if (r < p_new_change_) {
+      s = pick_existing(idx);
+      qty = rand_qty();
+      a = Action::Change;
+    } else {
+      s = pick_existing(idx);
+    }
+
+    // 太深时偏向删档
+    if (bids_.size() > cfg_.max_depth_soft && rng_.uniform() < 0.7) {
+      s = Side::Bid;
+      idx = rng_.index(bids_.size());
+      qty = 0;
+      a = Action::Delete;
+    }
+    if (asks_.size() > cfg_.max_depth_soft && rng_.uniform() < 0.7) {
+      s = Side::Ask;
+      idx = rng_.index(asks_.size());
+      qty = 0;
+      a = Action::Delete;
+    }
+
+    auto& book = side(s);
+    std::int64_t px = 0;
+    if (a == Action::New) {
+      const std::int64_t step = s == Side::Bid ? -cfg_.tick_size : cfg_.tick_size;
+      px = book.empty() ? mid_ + step : book.px.back() + step;
+    } else {
+      px = book.px[idx];
+    }
+    emit(sink, Kind::Incremental, s, px, qty, a);
+
+    // 应用到内部盘口；N 的价格在 worst 外侧，不会和已有档重复
+    if (a == Action::New) {
+      if (qty > 0) book.push_back(px, qty);
+    } else if (a == Action::Change && qty > 0) {
+      book.qty[idx] = qty;
+    } else {
+      book.erase(idx);
+    }
+    ++seq_;
+
+    // 任一边空了就重建，保持可交易
+    if (bids_.empty() || asks_.empty()) init_book();
+  }
+
+  MdGenConfig cfg_;
+  md_gen::Rng rng_;
+  double p_new_{0.0};
+  double p_new_change_{0.0};
+  std::int64_t ts_{0};
+  std::int64_t seq_{0};
+  std::int64_t mid_{0};
+  md_gen::Ladder bids_;
+  md_gen::Ladder asks_;
+};
+
+// n 个 symbol 写盘时 symbol i 的目录名：SYM 加零填充的下标 => 目录字典序即 symbol 序
+// （multi_backtest --data-dir 按文件名排序分配 sym_idx）
+inline std::string symbol_dir_name(std::size_t i, std::size_t n) {
+  const int width = static_cast<int>(std::to_string(n > 0 ? n - 1 : 0).size());
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "SYM%0*zu", width, i);
+  return buf;
+}
+
+// 一个 symbol 的完整事件流（喂 VectorReplay / SharedEvents）
+inline std::vector<MarketEvent> gen_md_events(const MdGenConfig& cfg) {
+  MdEventGen gen(cfg);
+  std::vector<MarketEvent> v;
+  v.reserve(gen.max_events());
+  gen.run([&v](const MarketEvent& e) { v.push_back(e); });
+  return v;
+}
+
+// [first, last) 的 symbol 分给 n_threads 个线程，fn(sym) 各自独立生成；symbol 之间不共享状态
+// => 结果与线程数无关，分片进程只生成自己那段也和全量生成的对应 symbol 逐条一致
+template <class Fn>
+void for_each_symbol_parallel(std::size_t first, std::size_t last, std::size_t n_threads, Fn&& fn) {
+  if (last <= first) return;
+  n_threads = std::clamp<std::size_t>(n_threads, 1, last - first);
+  std::atomic<std::size_t> next{first};
+  auto work = [&]() {
+    for (std::size_t s; (s = next.fetch_add(1, std::memory_order_relaxed)) < last;) fn(s);
+  };
+  std::vector<std::thread> ts;
+  ts.reserve(n_threads - 1);
+  for (std::size_t k = 1; k < n_threads; ++k) ts.emplace_back(work);
+  work();
+  for (auto& t : ts) t.join();
+}
+
+// symbol [first, last) 的事件流，下标 0 对应 first
+inline std::vector<std::vector<MarketEvent>> gen_md_symbols(const MdGenConfig& cfg,
+                                                            std::size_t first,
+                                                            std::size_t last,
+                                                            std::size_t n_threads) {
+  std::vector<std::vector<MarketEvent>> out(last > first ? last - first : 0);
+  for_each_symbol_parallel(first, last, n_threads,
+                           [&](std::size_t s) { out[s - first] = gen_md_events(symbol_config(cfg, s)); });
+  return out;
+}
+
+} // namespace q::market
@@ -1,7 +1,7 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdint>
-#include <deque>
+#include <fstream>
 #include <iostream>
 #include <optional>
 #include <string>
@@ -9,6 +9,7 @@
 #include "book/book_builder.hpp"
 #include "book/flat_l2_book.hpp"
 #include "common/clock.hpp"
+#include "common/rolling_stats.hpp"
 #include "common/latency.hpp"
 #include "common/log.hpp"
 #include "market/replay.hpp"
@@ -17,6 +18,7 @@
 #include "backtest/execution.hpp"
 #include "backtest/oms.hpp"
 #include "backtest/risk.hpp"
+#include "backtest/metrics.hpp"
 
 using namespace bt;
 
@@ -37,16 +39,16 @@ public:
   MeanReversionStrategy(std::size_t window,
                         double threshold,
                         std::int64_t trade_qty)
-      : window_(window), threshold_(threshold), trade_qty_(trade_qty) {}
+      : threshold_(threshold), trade_qty_(trade_qty), mids_(window) {}
 
   StratDecision on_market(const MarketView& mv, std::int64_t position) {
     StratDecision d;
     if (mv.best_bid_px <= 0 || mv.best_ask_px <= 0) return d;
 
-    push_mid(mv.mid_px);
-    if (mids_.size() < window_) return d;
+    mids_.push(mv.mid_px);
+    if (!mids_.full()) return d;
 
-    const double ma = mean_mid();
+    const double ma = mids_.mean();
     const double mid = static_cast<double>(mv.mid_px);
 
     const double upper = ma * (1.0 + threshold_);
@@ -132,26 +134,10 @@ public:
   std::int64_t working_sell_id() const { return working_sell_id_; }
 
 private:
-  void push_mid(std::int64_t mid) {
-    mids_.push_back(mid);
-    sum_ += static_cast<long double>(mid);
-    if (mids_.size() > window_) {
-      sum_ -= static_cast<long double>(mids_.front());
-      mids_.pop_front();
-    }
-  }
-
-  double mean_mid() const {
-    return static_cast<double>(sum_ / static_cast<long double>(mids_.size()));
-  }
-
-private:
-  std::size_t window_{200};
   double threshold_{0.001};
   std::int64_t trade_qty_{1};
 
-  std::deque<std::int64_t> mids_;
-  long double sum_{0.0L};
+  q::RollingStats<std::int64_t> mids_; // 容量 = window
 
   std::int64_t working_buy_id_{0};
   std::int64_t working_sell_id_{0};
@@ -180,69 +166,13 @@ struct Portfolio {
   }
 };
 
-// -------------------- Metrics --------------------
-struct Metrics {
-  // equity curve
-  std::vector<long double> equity;
-  std::vector<long double> returns; // simple returns per step
-
-  void add_equity(long double eq) {
-    if (!equity.empty()) {
-      const long double prev = equity.back();
-      if (prev != 0.0L) {
-        returns.push_back((eq - prev) / prev);
-      }
-    }
-    equity.push_back(eq);
-  }
-
-  long double total_return() const {
-    if (equity.size() < 2) return 0.0L;
-    const long double a = equity.front();
-    const long double b = equity.back();
-    if (a == 0.0L) return 0.0L;
-    return (b - a) / a;
-  }
-
-  long double max_drawdown() const {
-    if (equity.empty()) return 0.0L;
-    long double peak = equity.front();
-    long double maxdd = 0.0L;
-    for (auto e : equity) {
-      if (e > peak) peak = e;
-      if (peak > 0.0L) {
-        const long double dd = (peak - e) / peak;
-        if (dd > maxdd) maxdd = dd;
-      }
-    }
-    return maxdd;
-  }
-
-  // 简化 Sharpe：对 step returns 计算 mean/std，年化先不做（你后面可以按 bar 频率年化）
-  double sharpe() const {
-    if (returns.size() < 2) return 0.0;
-    long double sum = 0.0L;
-    for (auto r : returns) sum += r;
-    const long double mean = sum / static_cast<long double>(returns.size());
-
-    long double var = 0.0L;
-    for (auto r : returns) {
-      const long double d = r - mean;
-      var += d * d;
-    }
-    var /= static_cast<long double>(returns.size() - 1);
-    const long double sd = std::sqrt(static_cast<double>(var));
-    if (sd == 0.0L) return 0.0;
-    return static_cast<double>(mean / sd);
-  }
-};
-
 // -------------------- CLI --------------------
 static void usage() {
   std::cout
     << "Usage:\n"
     << "  ./backtest_min --file <md.csv> [--speed 0] [--sample 0|K]\n"
-    << "                [--cash C] [--window W] [--th T] [--qty Q]\n\n"
+    << "                [--cash C] [--window W] [--th T] [--qty Q] [--risk-timing]\n"
+    << "                [--progress N] [--equity-bucket-ns B] [--equity-csv out.csv]\n\n"
     << "Notes:\n"
     << "  Input CSV header:\n"
     << "    ts_ns,seq,kind,side,price,qty,action\n"
@@ -258,6 +188,10 @@ int main(int argc, char** argv) {
   std::size_t window = 200;
   double threshold = 0.001; // 0.1%
   std::int64_t trade_qty = 1;
+  bool risk_timing = false;
+  std::size_t progress_every = 0;               // 每 N 个 market view 打一次进度，0 = 关
+  std::int64_t equity_bucket_ns = 1'000'000'000; // equity 曲线降采样桶宽
+  std::string equity_csv;
 
   for (int i = 1; i < argc; ++i) {
     std::string a = argv[i];
@@ -268,6 +202,10 @@ int main(int argc, char** argv) {
     else if (a == "--window" && i + 1 < argc) window = static_cast<std::size_t>(std::stoull(argv[++i]));
     else if (a == "--th" && i + 1 < argc) threshold = std::stod(argv[++i]);
     else if (a == "--qty" && i + 1 < argc) trade_qty = static_cast<std::int64_t>(std::stoll(argv[++i]));
+    else if (a == "--risk-timing") risk_timing = true;
+    else if (a == "--progress" && i + 1 < argc) progress_every = static_cast<std::size_t>(std::stoull(argv[++i]));
+    else if (a == "--equity-bucket-ns" && i + 1 < argc) equity_bucket_ns = static_cast<std::int64_t>(std::stoll(argv[++i]));
+    else if (a == "--equity-csv" && i + 1 < argc) equity_csv = argv[++i];
     else if (a == "--help") { usage(); return 0; }
     else { q::log::warn("Unknown arg: " + a); usage(); return 1; }
   }
@@ -309,11 +247,12 @@ int main(int argc, char** argv) {
   rc.max_submits_per_sec = 50;
   rc.max_consecutive_rejects = 20;
   bt::RiskManager risk(rc);
+  risk.set_check_timing(risk_timing);
 
   Portfolio pf;
   pf.cash = init_cash;
 
-  Metrics mx;
+  bt::StreamingMetrics mx(equity_bucket_ns);
 
   std::size_t trades = 0;
   std::size_t fills_count = 0;
@@ -340,16 +279,18 @@ int main(int argc, char** argv) {
     auto fill_events = exec.on_market(oms, mv);
     for (auto fill_event : fill_events) {
         pf.on_fill(fill_event);
+        risk.on_fill(fill_event);
         ++fills_count;
     }
     for (auto up : exec.drain_updates()) {
         // 策略里处理 Filled/Cuanceled 来清 working id
         strat.on_order_updated(oms, up);
+        risk.on_order_update(up);
     }
 
     if (risk.killed()) {
       // 熔断后你可以选择：继续更新净值但不交易
-      mx.add_equity(pf.equity(mv.mid_px));
+      mx.add_equity(mv.ts_ns, pf.equity(mv.mid_px));
       return;
     }
 
@@ -380,6 +321,7 @@ int main(int argc, char** argv) {
         // strat.on_order_updated(oms, {mv.ts_ns, 0, bt::OrderStatus::Rejected, d.reason});
       } else {
         auto res = exec.submit(oms, mv, *dec.submit);
+        risk.on_submit_ack(*dec.submit, res.ack);
 
         // 执行层拒单也计入熔断
         if (res.ack.status == bt::OrderStatus::Rejected) {
@@ -395,6 +337,7 @@ int main(int argc, char** argv) {
         // submit 可能立刻产生 fill（partial/full）
         if (res.fill) {
             pf.on_fill(*res.fill);
+            risk.on_fill(*res.fill);
             ++fills_count;
             risk.on_good_event();
 
@@ -406,7 +349,19 @@ int main(int argc, char** argv) {
     }
 
     // 5) 更新净值
-    mx.add_equity(pf.equity(mv.mid_px));
+    mx.add_equity(mv.ts_ns, pf.equity(mv.mid_px));
+
+    if (progress_every > 0 && (market_views % progress_every) == 0) {
+      const auto r = mx.report();
+      std::cout << "[progress] ts=" << mv.ts_ns
+                << " views=" << market_views
+                << " fills=" << fills_count
+                << " equity=" << static_cast<double>(r.end_equity)
+                << " ret=" << static_cast<double>(r.total_return)
+                << " mdd=" << static_cast<double>(r.max_drawdown)
+                << " sharpe=" << r.sharpe
+                << "\n";
+    }
   }, (sample_every > 0 ? &cb_lat : nullptr), sample_every);
 
   // --------- Report ---------
@@ -417,13 +372,22 @@ int main(int argc, char** argv) {
   std::cout << "final_cash=" << static_cast<double>(pf.cash) << "\n";
   std::cout << "final_pos=" << pf.position << "\n";
 
-  if (!mx.equity.empty()) {
-    std::cout << "start_equity=" << static_cast<double>(mx.equity.front()) << "\n";
-    std::cout << "end_equity=" << static_cast<double>(mx.equity.back()) << "\n";
+  const auto rep = mx.report();
+  if (rep.points > 0) {
+    std::cout << "start_equity=" << static_cast<double>(rep.start_equity) << "\n";
+    std::cout << "end_equity=" << static_cast<double>(rep.end_equity) << "\n";
+  }
+  std::cout << "total_return=" << static_cast<double>(rep.total_return) << "\n";
+  std::cout << "max_drawdown=" << static_cast<double>(rep.max_drawdown) << "\n";
+  std::cout << "sharpe(step)=" << rep.sharpe << "\n";
+
+  if (!equity_csv.empty()) {
+    std::ofstream ofs(equity_csv);
+    ofs << "ts_ns,equity\n";
+    for (auto const& p : mx.curve()) ofs << p.ts_ns << "," << static_cast<double>(p.equity) << "\n";
+    std::cout << "equity_curve_points=" << mx.curve().size()
+              << " bucket_ns=" << mx.bucket_ns() << " -> " << equity_csv << "\n";
   }
-  std::cout << "total_return=" << static_cast<double>(mx.total_return()) << "\n";
-  std::cout << "max_drawdown=" << static_cast<double>(mx.max_drawdown()) << "\n";
-  std::cout << "sharpe(step)=" << mx.sharpe() << "\n";
 
   q::book::BuildState state = book_builder.state();
   std::cout << "\n=== BUILD STATS ===\n";
@@ -436,6 +400,20 @@ int main(int argc, char** argv) {
             << " anomaly=" << book_builder.stats().anomaly_count
             << "\n";
 
+  {
+    const auto names = risk.checks().names();
+    const auto& ctr = risk.checks().counters();
+    std::cout << "\n=== RISK CHECKS ===\n";
+    for (std::size_t i = 0; i < names.size(); ++i) {
+      std::cout << names[i] << " rejects=" << ctr[i].rejects;
+      if (risk_timing) {
+        const double avg = ctr[i].calls ? static_cast<double>(ctr[i].total_ns) / static_cast<double>(ctr[i].calls) : 0.0;
+        std::cout << " calls=" << ctr[i].calls << " avg(ns)=" << avg;
+      }
+      std::cout << "\n";
+    }
+  }
+
   if (sample_every > 0) {
     auto st = cb_lat.compute();
     std::cout << "\n=== Replay callback latency (sampled) ===\n";
@@ -1,46 +1,12 @@
 #include "market/replay.hpp"
 
-#include <charconv>
 #include <chrono>
 #include <thread>
 
 #include "common/clock.hpp"
 #include "common/csv.hpp"
 #include "common/log.hpp"
-
-namespace {
-
-inline bool parse_i64(std::string_view s, std::int64_t& out) {
-  const char* b = s.data();
-  const char* e = s.data() + s.size();
-  auto [ptr, ec] = std::from_chars(b, e, out);
-  return ec == std::errc{} && ptr == e;
-}
-
-inline bool parse_kind(std::string_view s, q::market::Kind& out) {
-  if (s == "SB") { out = q::market::Kind::SnapshotBegin; return true; }
-  if (s == "SL") { out = q::market::Kind::SnapshotLevel; return true; }
-  if (s == "SE") { out = q::market::Kind::SnapshotEnd; return true; }
-  if (s == "I")  { out = q::market::Kind::Incremental; return true; }
-  return false;
-}
-
-inline bool parse_side(std::string_view s, q::market::Side& out) {
-  if (s.empty()) { out = q::market::Side::Unknown; return true; }
-  if (s == "B" || s == "Bid" || s == "bid") { out = q::market::Side::Bid; return true; }
-  if (s == "A" || s == "Ask" || s == "ask") { out = q::market::Side::Ask; return true; }
-  return false;
-}
-
-inline bool parse_action(std::string_view s, q::market::Action& out) {
-  if (s.empty()) { out = q::market::Action::None; return true; }
-  if (s == "N") { out = q::market::Action::New; return true; }
-  if (s == "C") { out = q::market::Action::Change; return true; }
-  if (s == "D") { out = q::market::Action::Delete; return true; }
-  return false;
-}
-
-} // namespace
+#include "market/event_io.hpp"
 
 namespace q::market {
 
@@ -60,25 +26,9 @@ std::size_t ReplayEngine::run(const std::function<void(const MarketEvent&)>& on_
   TimePoint wall_start;
 
   while (auto line = reader.next_line()) {
-    auto fields = q::split_csv_line(*line);
-    if (fields.size() < 7) continue;
-
-    // header
-    if (n == 0 && (fields[0] == "ts_ns" || fields[2] == "kind")) {
-      continue;
-    }
-
+    // header / 坏行直接跳过
     MarketEvent e{};
-    if (!parse_i64(fields[0], e.ts_ns)) continue;
-    if (!parse_i64(fields[1], e.seq)) continue;
-    if (!parse_kind(fields[2], e.kind)) continue;
-    if (!parse_side(fields[3], e.side)) continue;
-
-    // price/qty can be empty for SB/SE
-    if (!fields[4].empty() && !parse_i64(fields[4], e.price)) continue;
-    if (!fields[5].empty() && !parse_i64(fields[5], e.qty)) continue;
-
-    if (!parse_action(fields[6], e.action)) continue;
+    if (!parse_csv_event(*line, e)) continue;
 
     if (first_ts < 0) {
         first_ts = e.ts_ns;
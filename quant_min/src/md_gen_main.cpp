@@ -0,0 +1,148 @@
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "market/event.hpp"
+#include "market/event_io.hpp"
+#include "market/md_event_gen.hpp"   // MdEventGen：tools/gen_md_events.py 的同模型 C++ 版
+
+namespace fs = std::filesystem;
+
+static void usage() {
+  std::cout
+    << "Usage:\n"
+    << "  ./md_gen --out FILE [options]          one symbol into FILE (.csv => CSV, otherwise binary)\n"
+    << "  ./md_gen --out-dir DIR --symbols N     N symbols as DIR/SYM<i>/day0.{bin,csv} (multi_backtest --data-dir layout)\n"
+    << "  --format bin|csv   file format for --out-dir (default bin)\n"
+    << "  --threads N        symbols generated in parallel (default: hardware threads)\n"
+    << "  --mid-step N       symbol i starts at base-mid + i*N (default 0)\n"
+    << "  --stagger-ns N     symbol i starts at start-ts + i*N (default 0 = all symbols on one ts grid)\n"
+    << "model / knobs (same names and defaults as tools/gen_md_events.py):\n"
+    << "  --seed S (42)  --events N incrementals per symbol (1000000)  --snapshot-every N (20000)\n"
+    << "  --depth N (200)  --max-depth-soft N (400)  --base-mid P (100000)  --tick-size T (1)\n"
+    << "  --spread-ticks N (2)  --qty-min Q (1)  --qty-max Q (20)  --start-ts NS (1700000000000000000)\n"
+    << "  --dt-ns NS (1000)  --start-seq S (100)\n"
+    << "  --p-new P (0.10)  --p-change P (0.80)  --p-delete P (0.10)  --p-mid-move P (0.02)\n"
+    << "  --gap-every N (0 = off)  --gap-size N (1)\n"
+    << "the same seed gives the same events for every thread count; symbol i does not depend on --symbols\n";
+}
+
+// 生成一个 symbol 直接写盘，不落中间 vector；返回行数（失败返回 0）
+template <class Writer>
+static std::size_t write_symbol(const q::market::MdGenConfig& cfg, const std::string& path) {
+  Writer w(path);
+  q::market::MdEventGen gen(cfg);
+  gen.run([&w](const q::market::MarketEvent& e) { w.write(e); });
+  w.close();
+  return w.good() ? w.written() : 0;
+}
+
+int main(int argc, char** argv) {
+  q::market::MdGenConfig cfg;
+  std::string out_file;
+  std::string out_dir;
+  bool csv = false;
+  std::size_t n_syms = 1;
+  std::size_t n_threads = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+
+  for (int i = 1; i < argc; ++i) {
+    std::string a = argv[i];
+    if (a == "--out" && i + 1 < argc) out_file = argv[++i];
+    else if (a == "--out-dir" && i + 1 < argc) out_dir = argv[++i];
+    else if (a == "--format" && i + 1 < argc) {
+      const std::string f = argv[++i];
+      if (f != "bin" && f != "csv") { std::cerr << "--format must be bin or csv\n"; return 1; }
+      csv = f == "csv";
+    }
+    else if (a == "--symbols" && i + 1 < argc) n_syms = static_cast<std::size_t>(std::stoull(argv[++i]));
+    else if (a == "--threads" && i + 1 < argc) n_threads = static_cast<std::size_t>(std::stoull(argv[++i]));
+    else if (a == "--mid-step" && i + 1 < argc) cfg.mid_step = std::stoll(argv[++i]);
+    else if (a == "--stagger-ns" && i + 1 < argc) cfg.stagger_ns = std::stoll(argv[++i]);
+    else if (a == "--seed" && i + 1 < argc) cfg.seed = std::stoull(argv[++i]);
+    else if (a == "--events" && i + 1 < argc) cfg.events = std::stoll(argv[++i]);
+    else if (a == "--snapshot-every" && i + 1 < argc) cfg.snapshot_every = std::stoll(argv[++i]);
+    else if (a == "--depth" && i + 1 < argc) cfg.depth = static_cast<std::size_t>(std::stoull(argv[++i]));
+    else if (a == "--max-depth-soft" && i + 1 < argc) cfg.max_depth_soft = static_cast<std::size_t>(std::stoull(argv[++i]));
+    else if (a == "--base-mid" && i + 1 < argc) cfg.base_mid = std::stoll(argv[++i]);
+    else if (a == "--tick-size" && i + 1 < argc) cfg.tick_size = std::stoll(argv[++i]);
+    else if (a == "--spread-ticks" && i + 1 < argc) cfg.spread_ticks = std::stoll(argv[++i]);
+    else if (a == "--qty-min" && i + 1 < argc) cfg.qty_min = std::stoll(argv[++i]);
+    else if (a == "--qty-max" && i + 1 < argc) cfg.qty_max = std::stoll(argv[++i]);
+    else if (a == "--start-ts" && i + 1 < argc) cfg.start_ts = std::stoll(argv[++i]);
+    else if (a == "--dt-ns" && i + 1 < argc) cfg.dt_ns = std::stoll(argv[++i]);
+    else if (a == "--start-seq" && i + 1 < argc) cfg.start_seq = std::stoll(argv[++i]);
+    else if (a == "--p-new" && i + 1 < argc) cfg.p_new = std::stod(argv[++i]);
+    else if (a == "--p-change" && i + 1 < argc) cfg.p_change = std::stod(argv[++i]);
+    else if (a == "--p-delete" && i + 1 < argc) cfg.p_delete = std::stod(argv[++i]);
+    else if (a == "--p-mid-move" && i + 1 < argc) cfg.p_mid_move = std::stod(argv[++i]);
+    else if (a == "--gap-every" && i + 1 < argc) cfg.gap_every = std::stoll(argv[++i]);
+    else if (a == "--gap-size" && i + 1 < argc) cfg.gap_size = std::stoll(argv[++i]);
+    else if (a == "--help") { usage(); return 0; }
+    else { std::cerr << "Unknown arg: " << a << "\n"; usage(); return 1; }
+  }
+
+  if (const char* err = q::market::validate(cfg)) {
+    std::cerr << err << "\n";
+    return 1;
+  }
+  if (out_file.empty() == out_dir.empty()) {
+    std::cerr << "Need exactly one of --out FILE or --out-dir DIR\n";
+    usage();
+    return 1;
+  }
+  if (!out_file.empty() && n_syms != 1) {
+    std::cerr << "--out writes one symbol; use --out-dir for --symbols N\n";
+    return 1;
+  }
+  if (n_syms == 0) {
+    std::cerr << "--symbols must be > 0\n";
+    return 1;
+  }
+
+  const auto t0 = std::chrono::steady_clock::now();
+  std::atomic<std::size_t> lines{0};
+  std::atomic<std::size_t> failed{0};
+
+  if (!out_file.empty()) {
+    // 单文件：与 gen_md_events.py 一样是 symbol 0 的流，格式看扩展名
+    const auto sc = q::market::symbol_config(cfg, 0);
+    const std::size_t n = fs::path(out_file).extension() == ".csv"
+                              ? write_symbol<q::market::CsvEventWriter>(sc, out_file)
+                              : write_symbol<q::market::bin::EventWriter>(sc, out_file);
+    if (n == 0) failed.fetch_add(1);
+    lines.fetch_add(n);
+  } else {
+    std::error_code ec;
+    fs::create_directories(out_dir, ec);
+    q::market::for_each_symbol_parallel(0, n_syms, n_threads, [&](std::size_t s) {
+      const auto sym_dir = fs::path(out_dir) / q::market::symbol_dir_name(s, n_syms);
+      std::error_code dec;
+      fs::create_directories(sym_dir, dec);
+      const auto sc = q::market::symbol_config(cfg, s);
+      const std::size_t n = csv ? write_symbol<q::market::CsvEventWriter>(sc, (sym_dir / "day0.csv").string())
+                                : write_symbol<q::market::bin::EventWriter>(sc, (sym_dir / "day0.bin").string());
+      if (n == 0) failed.fetch_add(1, std::memory_order_relaxed);
+      lines.fetch_add(n, std::memory_order_relaxed);
+    });
+  }
+
+  const double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  if (failed.load() > 0) {
+    std::cerr << "Failed to write " << failed.load() << " of " << n_syms << " symbol file(s)\n";
+    return 1;
+  }
+  std::cout << "md_gen out=" << (out_file.empty() ? out_dir : out_file)
+            << " symbols=" << n_syms
+            << " format=" << (out_file.empty() ? (csv ? "csv" : "bin") : (fs::path(out_file).extension() == ".csv" ? "csv" : "bin"))
+            << " incrementals_per_symbol=" << cfg.events
+            << " lines=" << lines.load()
+            << " threads=" << std::min(n_threads, n_syms)
+            << " wall_s=" << wall_s
+            << " lines_per_s=" << (wall_s > 0 ? static_cast<double>(lines.load()) / wall_s : 0.0) << "\n";
+  return 0;
+}